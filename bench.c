@@ -0,0 +1,1062 @@
+// -----------------------------------bench.c -------------------------------------
+#include "bench.h"
+#include "uart1.h"
+#include "timer.h"
+#include "smp.h"
+#include "mmu.h"
+#include "string.h"
+#include "cma.h"
+#include "mbox.h"
+#include "board.h"
+#include "framebf.h"
+#include "cpufreq.h"
+#include "telemetry.h"
+#include "blit.h"
+
+#define MEMBENCH_BYTES (48UL << 20) // scratch memory taken from the CMA region
+
+/* STREAM kernels */
+#define KERNEL_COPY 0
+#define KERNEL_SCALE 1
+#define KERNEL_ADD 2
+#define KERNEL_TRIAD 3
+#define NUM_KERNELS 4
+
+/* Bytes moved per element by each kernel (reads + writes of 8-byte doubles) */
+static const unsigned int kernel_bytes[NUM_KERNELS] = {16, 16, 24, 24};
+
+/* Per-array sizes in bytes (the working set is 3x this) */
+static const unsigned long stream_sizes[] = {
+	4 << 10, 8 << 10, 32 << 10, 128 << 10, 512 << 10, 2 << 20, 8 << 20, 16 << 20};
+#define NUM_STREAM_SIZES (sizeof(stream_sizes) / sizeof(stream_sizes[0]))
+
+/* Pointer-chasing buffer sizes in bytes (per core) */
+static const unsigned long chase_sizes[] = {
+	4 << 10, 16 << 10, 32 << 10, 128 << 10, 256 << 10, 1 << 20, 4 << 20, 8 << 20};
+#define NUM_CHASE_SIZES (sizeof(chase_sizes) / sizeof(chase_sizes[0]))
+
+#define STREAM_TARGET_BYTES (64UL << 20) // bytes moved per measurement
+#define STREAM_NTIMES 3					 // best of N measurements
+#define CHASE_STEPS (1UL << 20)
+#define CHASE_STRIDE 64 // one node per cache line
+
+/* Work handed to each core */
+struct membench_job
+{
+	double *a, *b, *c;
+	unsigned long n;
+	unsigned int reps;
+	unsigned int kernel;
+	unsigned long *chase;
+	unsigned long steps;
+	unsigned long sink;
+};
+
+static struct membench_job jobs[SMP_MAX_CORES];
+
+/**
+ * Print an unsigned value right-aligned in a column
+ */
+void bench_print_col(unsigned long v, int width)
+{
+	char str[21];
+	int len = 0;
+
+	do
+	{
+		str[len++] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+
+	for (int i = len; i < width; i++)
+		uart_sendc(' ');
+	while (len)
+		uart_sendc(str[--len]);
+}
+
+/**
+ * Print a string right-aligned in a column
+ */
+void bench_print_label(char *s, int width)
+{
+	int len = 0;
+	while (s[len])
+		len++;
+	for (int i = len; i < width; i++)
+		uart_sendc(' ');
+	uart_puts(s);
+}
+
+/**
+ * Print a value given in tenths as "N.N" right-aligned in a column
+ */
+void bench_print_tenths(unsigned long tenths, int width)
+{
+	bench_print_col(tenths / 10, width - 2);
+	uart_sendc('.');
+	uart_sendc('0' + tenths % 10);
+}
+
+/**
+ * Print a byte size as B/KB/MB right-aligned in a column
+ */
+void bench_print_size(unsigned long bytes, int width)
+{
+	char *unit = "B ";
+	if (bytes >= (1 << 20) && !(bytes & ((1 << 20) - 1)))
+	{
+		bytes >>= 20;
+		unit = "MB";
+	}
+	else if (bytes >= (1 << 10) && !(bytes & ((1 << 10) - 1)))
+	{
+		bytes >>= 10;
+		unit = "KB";
+	}
+	bench_print_col(bytes, width - 2);
+	uart_puts(unit);
+}
+
+/**
+ * Print the ARM clock a benchmark runs at and the policy that set it
+ */
+static void bench_print_clock()
+{
+	uart_puts("ARM clock ");
+	uart_dec(cpufreq_current_rate() / 1000000);
+	uart_puts(" MHz (");
+	uart_puts(cpufreq_policy_name(cpufreq_policy()));
+	uart_puts(")");
+}
+
+/**
+ * Warn if telemetry saw the SoC throttled since start (counter ticks):
+ * the numbers above were then measured at a lower clock
+ */
+static void bench_check_throttle(uint64_t start)
+{
+	if (telemetry_throttled_since(start))
+		uart_puts("Warning: the SoC was throttled during this run, results are not comparable.\n");
+}
+
+/**
+ * Start a benchmark: hold the ARM clock up (cpufreq busy) and print the
+ * title line with the clock the run uses. Returns the start time to pass
+ * to bench_end().
+ */
+uint64_t bench_begin(char *title)
+{
+	uint64_t start = timer_counter();
+	cpufreq_busy_begin();
+	uart_puts("\n");
+	uart_puts(title);
+	uart_puts(", ");
+	bench_print_clock();
+	uart_puts("\n");
+	return start;
+}
+
+/**
+ * Finish a benchmark started by bench_begin(): release the clock and warn
+ * if the SoC was throttled while it ran
+ */
+void bench_end(uint64_t start)
+{
+	cpufreq_busy_end();
+	bench_check_throttle(start);
+}
+
+static void stream_run(void *arg)
+{
+	struct membench_job *job = arg;
+	double *a = job->a, *b = job->b, *c = job->c;
+	const double scalar = 3.0;
+
+	for (unsigned int r = 0; r < job->reps; r++)
+	{
+		switch (job->kernel)
+		{
+		case KERNEL_COPY:
+			for (unsigned long j = 0; j < job->n; j++)
+				c[j] = a[j];
+			break;
+		case KERNEL_SCALE:
+			for (unsigned long j = 0; j < job->n; j++)
+				b[j] = scalar * c[j];
+			break;
+		case KERNEL_ADD:
+			for (unsigned long j = 0; j < job->n; j++)
+				c[j] = a[j] + b[j];
+			break;
+		default:
+			for (unsigned long j = 0; j < job->n; j++)
+				a[j] = b[j] + scalar * c[j];
+			break;
+		}
+		// keep the compiler from merging repetitions
+		asm volatile("" ::: "memory");
+	}
+}
+
+static void chase_run(void *arg)
+{
+	struct membench_job *job = arg;
+	unsigned long *p = job->chase;
+
+	for (unsigned long i = 0; i < job->steps; i++)
+		p = (unsigned long *)*p;
+	job->sink = (unsigned long)p;
+}
+
+/**
+ * Build a single random cycle through all nodes of the buffer (Sattolo's
+ * algorithm), so the hardware prefetchers cannot predict the next line
+ */
+static void chase_setup(unsigned long *buf, unsigned long bytes, unsigned long seed)
+{
+	unsigned long stride = CHASE_STRIDE / sizeof(unsigned long);
+	unsigned long nodes = bytes / CHASE_STRIDE;
+
+	for (unsigned long i = 0; i < nodes; i++)
+		buf[i * stride] = i;
+
+	for (unsigned long i = nodes - 1; i > 0; i--)
+	{
+		// xorshift64
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		unsigned long j = seed % i;
+		unsigned long t = buf[i * stride];
+		buf[i * stride] = buf[j * stride];
+		buf[j * stride] = t;
+	}
+
+	for (unsigned long i = 0; i < nodes; i++)
+		buf[i * stride] = (unsigned long)&buf[buf[i * stride] * stride];
+}
+
+/**
+ * Run fn on cores 0..ncores-1 with their own job and return the elapsed ticks
+ */
+static uint64_t run_on_cores(void (*fn)(void *), unsigned int ncores)
+{
+	uint64_t start = timer_counter();
+
+	for (unsigned int core = 1; core < ncores; core++)
+		smp_start_core(core, fn, &jobs[core]);
+	fn(&jobs[0]);
+	for (unsigned int core = 1; core < ncores; core++)
+		smp_wait_core(core);
+
+	return timer_counter() - start;
+}
+
+static void membench_stream(char *scratch, unsigned int ncores)
+{
+	static char *names[NUM_KERNELS] = {"Copy", "Scale", "Add", "Triad"};
+	double *base = (double *)scratch;
+	unsigned long max_elems = MEMBENCH_BYTES / (3 * sizeof(double));
+
+	uart_puts("\nSTREAM bandwidth (MB/s, best of 3)\n");
+	uart_puts("  Working set");
+	for (int k = 0; k < NUM_KERNELS; k++)
+		bench_print_label(names[k], 10);
+	uart_puts("\n");
+
+	for (unsigned int s = 0; s < NUM_STREAM_SIZES; s++)
+	{
+		unsigned long n = stream_sizes[s] / sizeof(double);
+		if (n > max_elems)
+			break;
+
+		double *a = base, *b = base + n, *c = base + 2 * n;
+		for (unsigned long j = 0; j < n; j++)
+		{
+			a[j] = 1.0;
+			b[j] = 2.0;
+			c[j] = 0.0;
+		}
+
+		// Split the arrays among the cores
+		unsigned long per_core = n / ncores;
+		unsigned int reps = STREAM_TARGET_BYTES / (3 * stream_sizes[s]);
+		if (reps == 0)
+			reps = 1;
+
+		bench_print_size(3 * stream_sizes[s], 13);
+		for (unsigned int k = 0; k < NUM_KERNELS; k++)
+		{
+			uint64_t best = ~0UL;
+			for (unsigned int core = 0; core < ncores; core++)
+			{
+				jobs[core].a = a + core * per_core;
+				jobs[core].b = b + core * per_core;
+				jobs[core].c = c + core * per_core;
+				jobs[core].n = per_core;
+				jobs[core].reps = reps;
+				jobs[core].kernel = k;
+			}
+			for (int t = 0; t < STREAM_NTIMES; t++)
+			{
+				uint64_t ticks = run_on_cores(stream_run, ncores);
+				if (ticks < best)
+					best = ticks;
+			}
+
+			uint64_t bytes = (uint64_t)kernel_bytes[k] * per_core * ncores * reps;
+			uint64_t ns = timer_ticks_to_ns(best);
+			bench_print_col(ns ? bytes * 1000 / ns : 0, 10);
+		}
+		uart_puts("\n");
+	}
+}
+
+static void membench_latency(char *scratch, unsigned int ncores)
+{
+	unsigned long region = MEMBENCH_BYTES / ncores;
+
+	uart_puts("\nLoad-to-use latency (ns/access, random pointer chase)\n");
+	uart_puts("  Buffer/core  ns/access\n");
+
+	for (unsigned int s = 0; s < NUM_CHASE_SIZES; s++)
+	{
+		if (chase_sizes[s] > region)
+			break;
+
+		for (unsigned int core = 0; core < ncores; core++)
+		{
+			jobs[core].chase = (unsigned long *)(scratch + core * region);
+			jobs[core].steps = CHASE_STEPS;
+			chase_setup(jobs[core].chase, chase_sizes[s], 0x9E3779B97F4A7C15UL + core);
+		}
+
+		// Warm up once, then measure
+		run_on_cores(chase_run, ncores);
+		uint64_t ns = timer_ticks_to_ns(run_on_cores(chase_run, ncores));
+
+		bench_print_size(chase_sizes[s], 13);
+		bench_print_tenths(ns * 10 / CHASE_STEPS, 11);
+		uart_puts("\n");
+	}
+}
+
+/**
+ * STREAM-style copy/scale/add/triad bandwidth and pointer-chasing latency
+ * across working-set sizes, run on 1 to 4 cores
+ */
+void membench(unsigned int ncores)
+{
+	if (ncores < 1 || ncores > SMP_MAX_CORES)
+	{
+		uart_puts("Usage: membench [1-4]\n");
+		return;
+	}
+	for (unsigned int core = 1; core < ncores; core++)
+	{
+		if (!smp_core_online(core))
+		{
+			uart_puts("Core ");
+			uart_dec(core);
+			uart_puts(" is not online.\n");
+			return;
+		}
+	}
+
+	char *scratch = cma_alloc(MEMBENCH_BYTES, CMA_ALIGN_2M);
+	if (!scratch)
+	{
+		uart_puts("Not enough contiguous memory.\n");
+		return;
+	}
+
+	uint64_t start = bench_begin("Memory bandwidth and latency");
+	uart_dec(ncores);
+	uart_puts(ncores > 1 ? " cores" : " core");
+	uart_puts(", counter ");
+	uart_dec(timer_frequency());
+	uart_puts(" Hz, caches ");
+	uart_puts(mmu_enabled() ? "on" : "off");
+	uart_puts("\n");
+
+	membench_stream(scratch, ncores);
+	membench_latency(scratch, ncores);
+	bench_end(start);
+	cma_free(scratch);
+	uart_puts("\n");
+}
+
+/* String lengths tried by strbench (the buffer holds the longest) */
+static const unsigned int str_lengths[] = {7, 16, 64, 256, 1024, 4096};
+#define NUM_STR_LENGTHS (sizeof(str_lengths) / sizeof(str_lengths[0]))
+#define STR_TARGET_BYTES (4UL << 20) // bytes scanned per measurement
+
+static char __attribute__((aligned(16))) str_buf[4096 + 16];
+static volatile unsigned long str_sink;
+
+/* Each variant under test is wrapped to a common signature */
+static unsigned long t_strlen_byte(const char *s) { return strlen_bytewise(s); }
+static unsigned long t_strlen_swar(const char *s) { return strlen_swar(s); }
+static unsigned long t_strlen_neon(const char *s) { return strlen_neon(s); }
+static unsigned long t_strchr_byte(const char *s) { return (unsigned long)strchr_bytewise(s, '#'); }
+static unsigned long t_strchr_swar(const char *s) { return (unsigned long)strchr_swar(s, '#'); }
+static unsigned long t_strchr_neon(const char *s) { return (unsigned long)strchr_neon(s, '#'); }
+static unsigned long t_strspn_byte(const char *s) { return strspn_bytewise(s, "abcdefghijklmnop"); }
+static unsigned long t_strspn_table(const char *s) { return strspn(s, "abcdefghijklmnop"); }
+
+/**
+ * Return the cost of one call in tenths of a nanosecond
+ */
+static unsigned long str_time(unsigned long (*fn)(const char *), const char *s, unsigned int len)
+{
+	unsigned long iters = STR_TARGET_BYTES / (len + 16);
+	unsigned long sink = 0;
+
+	uint64_t start = timer_counter();
+	for (unsigned long i = 0; i < iters; i++)
+		sink += fn(s);
+	uint64_t ticks = timer_counter() - start;
+
+	str_sink = sink;
+	return timer_ticks_to_ns(ticks) * 10 / iters;
+}
+
+/**
+ * Compare the byte loop, SWAR and NEON string routines (ns per call)
+ */
+void strbench()
+{
+	static char *names[] = {"strlen:byte", "swar", "neon", "strchr:byte", "swar", "neon", "strspn:O(nm)", "table"};
+	static unsigned long (*fns[])(const char *) = {
+		t_strlen_byte, t_strlen_swar, t_strlen_neon,
+		t_strchr_byte, t_strchr_swar, t_strchr_neon,
+		t_strspn_byte, t_strspn_table};
+	int nfns = sizeof(fns) / sizeof(fns[0]);
+
+	uint64_t start = bench_begin("String routines (ns/call, string starts 1 byte past alignment)");
+	uart_puts(" Length");
+	for (int f = 0; f < nfns; f++)
+		bench_print_label(names[f], f % 3 == 0 ? 13 : 7);
+	uart_puts("\n");
+
+	// Characters come from the strspn set, so every routine scans the whole string
+	for (int i = 0; i < sizeof(str_buf); i++)
+		str_buf[i] = 'a' + i % 16;
+
+	for (unsigned int l = 0; l < NUM_STR_LENGTHS; l++)
+	{
+		unsigned int len = str_lengths[l];
+		char *s = str_buf + 1;
+		s[len] = '\0';
+
+		bench_print_col(len, 7);
+		for (int f = 0; f < nfns; f++)
+			bench_print_tenths(str_time(fns[f], s, len), f % 3 == 0 ? 13 : 7);
+		uart_puts("\n");
+
+		s[len] = 'a' + (len + 1) % 16;
+	}
+	bench_end(start);
+	uart_puts("\n");
+}
+
+#define MBOXBENCH_MAX 1000
+#define MBOXBENCH_TESTS 5
+#define MBOXBENCH_BUCKETS 12 // histogram buckets: < 1 us, < 2 us, ... < 1024 us, more
+
+/* Round trip times in ns, one row per test */
+static unsigned long mbox_samples[MBOXBENCH_TESTS][MBOXBENCH_MAX];
+
+/* Queries timed by mboxbench: a single tag each, all three in sequence, or batched */
+#define MBOX_TEST_REVISION 1
+#define MBOX_TEST_CLOCK 2
+#define MBOX_TEST_PITCH 4
+
+/**
+ * One mailbox call holding the selected queries, from building the message
+ * to releasing it
+ */
+static void mbox_query(unsigned int tests)
+{
+	struct mbox_msg msg;
+	unsigned int clock_id[2] = {CLOCK_ARM, 0};
+
+	mbox_msg_begin(&msg);
+	if (tests & MBOX_TEST_REVISION)
+		mbox_msg_add(&msg, MBOX_TAG_GETREVISION, 0, 0, 1);
+	if (tests & MBOX_TEST_CLOCK)
+		mbox_msg_add(&msg, MBOX_TAG_GETCLKRATE, clock_id, 2, 2);
+	if (tests & MBOX_TEST_PITCH)
+		mbox_msg_add(&msg, MBOX_TAG_GETPITCH, 0, 0, 1);
+	mbox_msg_send(&msg);
+	mbox_msg_end(&msg);
+}
+
+/**
+ * Time one call per entry of tests, back to back; return the total in ns
+ */
+static unsigned long mbox_time(const unsigned int *tests, int ncalls)
+{
+	uint64_t start = timer_counter();
+	for (int i = 0; i < ncalls; i++)
+		mbox_query(tests[i]);
+	return timer_ticks_to_ns(timer_counter() - start);
+}
+
+static void sort_samples(unsigned long *v, unsigned int n)
+{
+	// Shell sort: no recursion, fine for a few thousand samples
+	for (unsigned int gap = n / 2; gap > 0; gap /= 2)
+		for (unsigned int i = gap; i < n; i++)
+		{
+			unsigned long t = v[i];
+			unsigned int j = i;
+			for (; j >= gap && v[j - gap] > t; j -= gap)
+				v[j] = v[j - gap];
+			v[j] = t;
+		}
+}
+
+/**
+ * Sort n samples (ns) and print min/median/p99/max in microseconds
+ */
+static void print_latency(char *name, unsigned long *v, unsigned int n)
+{
+	sort_samples(v, n);
+
+	bench_print_label(name, 12);
+	bench_print_tenths(v[0] / 100, 8);
+	bench_print_tenths(v[n / 2] / 100, 8);
+	bench_print_tenths(v[(n * 99) / 100 < n ? (n * 99) / 100 : n - 1] / 100, 8);
+	bench_print_tenths(v[n - 1] / 100, 8);
+	uart_puts("\n");
+}
+
+static unsigned int mbox_bucket(unsigned long ns)
+{
+	unsigned int b = 0;
+	for (unsigned long limit = 1000; b < MBOXBENCH_BUCKETS - 1 && ns >= limit; limit <<= 1)
+		b++;
+	return b;
+}
+
+/**
+ * Mailbox round trip latency: n calls per query type, then three single-tag
+ * calls in a row against the same three tags batched in one message.
+ * Prints min/median/p99/max in microseconds and a latency histogram.
+ */
+void mboxbench(unsigned int n)
+{
+	static char *names[MBOXBENCH_TESTS] = {"revision", "clock rate", "fb pitch", "3 x single", "batched"};
+	static const unsigned int single[] = {MBOX_TEST_REVISION, MBOX_TEST_CLOCK, MBOX_TEST_PITCH};
+	static const unsigned int batched = MBOX_TEST_REVISION | MBOX_TEST_CLOCK | MBOX_TEST_PITCH;
+
+	if (n < 1 || n > MBOXBENCH_MAX)
+	{
+		uart_puts("Usage: mboxbench [1-1000]\n");
+		return;
+	}
+
+	uint64_t start = bench_begin("Mailbox round trip (us)");
+	uart_dec(n);
+	uart_puts(" calls per query\n");
+	uart_puts("       Query     min  median     p99     max\n");
+
+	// A call must not queue behind a telemetry sample
+	unsigned int sampling = telemetry_pause();
+	for (unsigned int i = 0; i < n; i++)
+	{
+		mbox_samples[0][i] = mbox_time(&single[0], 1);
+		mbox_samples[1][i] = mbox_time(&single[1], 1);
+		mbox_samples[2][i] = mbox_time(&single[2], 1);
+		mbox_samples[3][i] = mbox_time(single, 3);
+		mbox_samples[4][i] = mbox_time(&batched, 1);
+	}
+	telemetry_resume(sampling);
+
+	for (int t = 0; t < MBOXBENCH_TESTS; t++)
+		print_latency(names[t], mbox_samples[t], n);
+
+	// Histogram of the sequence against the batched message
+	unsigned int counts[2][MBOXBENCH_BUCKETS] = {{0}};
+	for (unsigned int i = 0; i < n; i++)
+	{
+		counts[0][mbox_bucket(mbox_samples[3][i])]++;
+		counts[1][mbox_bucket(mbox_samples[4][i])]++;
+	}
+
+	uart_puts("\n   Latency  3 x single  batched\n");
+	unsigned long limit = 1000;
+	for (int b = 0; b < MBOXBENCH_BUCKETS; b++, limit <<= 1)
+	{
+		if (b < MBOXBENCH_BUCKETS - 1)
+		{
+			uart_puts("  < ");
+			bench_print_col(limit / 1000, 4);
+		}
+		else
+		{
+			uart_puts(" >= ");
+			bench_print_col(limit / 2000, 4);
+		}
+		uart_puts(" us");
+		bench_print_col(counts[0][b], 12);
+		bench_print_col(counts[1][b], 9);
+		uart_puts("\n");
+	}
+	bench_end(start);
+	uart_puts("\n");
+}
+
+#define FLIPBENCH_MAX 200
+
+static unsigned long flip_samples[3][FLIPBENCH_MAX];
+
+/**
+ * Cost of showing a frame, n frames each: a fully redrawn frame presented
+ * by page flip (SETVIRTOFF), a frame where one line of text changed (only
+ * the dirty regions are copied before the flip), and copying the whole
+ * drawn page over the visible one
+ */
+void flipbench(unsigned int n)
+{
+	const struct fb_state *fb = fb_info();
+	static char line[] = "flipbench: one line of text changed since the last frame";
+	unsigned long line_bytes = 0;
+
+	if (n < 1 || n > FLIPBENCH_MAX)
+	{
+		uart_puts("Usage: flipbench [1-200]\n");
+		return;
+	}
+	if (fb->pages != 2)
+	{
+		uart_puts("The frame buffer is not double buffered.\n");
+		return;
+	}
+
+	uint64_t start = bench_begin("Presenting frames (us)");
+	uart_dec(fb->width);
+	uart_puts("x");
+	uart_dec(fb->height);
+	uart_puts(" frame (");
+	uart_dec(fb->height * fb->pitch >> 10);
+	uart_puts(" KB), ");
+	uart_dec(n);
+	uart_puts(" frames\n");
+
+	// Flips are mailbox calls: keep telemetry samples out of their way
+	unsigned int sampling = telemetry_pause();
+	for (unsigned int i = 0; i < n; i++)
+	{
+		uint64_t t = timer_counter();
+		fb_dirty(0, 0, fb->width - 1, fb->height - 1);
+		fb_present();
+		flip_samples[0][i] = timer_ticks_to_ns(timer_counter() - t);
+
+		t = timer_counter();
+		drawString(0, fb->height - 16, line, 0x0f);
+		fb_present();
+		flip_samples[1][i] = timer_ticks_to_ns(timer_counter() - t);
+		line_bytes = fb->present_bytes;
+
+		t = timer_counter();
+		fb_present_copy();
+		flip_samples[2][i] = timer_ticks_to_ns(timer_counter() - t);
+	}
+	telemetry_resume(sampling);
+
+	uart_puts("      Method     min  median     p99     max\n");
+	print_latency("flip", flip_samples[0], n);
+	print_latency("line", flip_samples[1], n);
+	print_latency("copy", flip_samples[2], n);
+	if (fb->shadow)
+	{
+		uart_puts("Text line frame copied ");
+		uart_dec(line_bytes);
+		uart_puts(" bytes to the hidden page\n");
+	}
+	else
+		uart_puts("No cached back buffer: frames are flipped without copying\n");
+	bench_end(start);
+	uart_puts("\n");
+}
+
+/* Rectangle fills timed by fillbench: full screen, 256x256 filled and outlined */
+#define FILL_SMALL 256
+
+/*
+ * Average time of reps calls to one of the two drawRect versions, in ns
+ */
+static unsigned long fill_time(void (*fn)(int, int, int, int, unsigned int, int),
+							   int x2, int y2, int fill, unsigned int reps)
+{
+	uint64_t start = timer_counter();
+	for (unsigned int i = 0; i < reps; i++)
+		fn(0, 0, x2, y2, i & 0x0f, fill);
+	return timer_ticks_to_ns(timer_counter() - start) / reps;
+}
+
+/**
+ * Per-pixel drawRect against the span fills (clearScreen is a full-screen
+ * fill_rect)
+ */
+void fillbench()
+{
+	const struct fb_state *fb = fb_info();
+	static char *names[] = {"clearScreen", "fill 256", "outline 256"};
+	int x2[] = {fb->width - 1, FILL_SMALL - 1, FILL_SMALL - 1};
+	int y2[] = {fb->height - 1, FILL_SMALL - 1, FILL_SMALL - 1};
+	int fill[] = {1, 1, 0};
+	unsigned int reps[] = {4, 32, 256};
+
+	uint64_t start = bench_begin("Rectangle fills on the back page (us/call)");
+	uart_dec(fb->width);
+	uart_puts("x");
+	uart_dec(fb->height);
+	uart_puts(" screen\n");
+	uart_puts("        Shape  per-pixel      span  speedup\n");
+
+	for (int t = 0; t < 3; t++)
+	{
+		unsigned long old_ns = fill_time(drawRect_pixelwise, x2[t], y2[t], fill[t], reps[t]);
+		unsigned long new_ns = fill_time(drawRect, x2[t], y2[t], fill[t], reps[t]);
+
+		bench_print_label(names[t], 13);
+		bench_print_tenths(old_ns / 100, 11);
+		bench_print_tenths(new_ns / 100, 10);
+		bench_print_tenths(new_ns ? old_ns * 10 / new_ns : 0, 8);
+		uart_puts("x\n");
+	}
+	bench_end(start);
+	uart_puts("\n");
+}
+
+#define BLIT_REPS 4
+
+/*
+ * Megapixels per second (in tenths) of reps fills or copies of n pixels.
+ * A NULL src times fill_fn instead of copy_fn.
+ */
+static unsigned long blit_rate(void (*fill_fn)(unsigned int *, unsigned long, unsigned int),
+							   void (*copy_fn)(unsigned int *, const unsigned int *, unsigned long),
+							   unsigned int *dst, const unsigned int *src, unsigned long n)
+{
+	uint64_t start = timer_counter();
+	for (unsigned int i = 0; i < BLIT_REPS; i++)
+	{
+		if (src)
+			copy_fn(dst, src, n);
+		else
+			fill_fn(dst, n, 0x00102030 * i);
+	}
+	unsigned long us = timer_ticks_to_us(timer_counter() - start);
+	return us ? n * BLIT_REPS * 10 / us : 0;
+}
+
+/**
+ * Scalar, 64-bit and NEON fill/copy kernels in megapixels per second, into
+ * the (uncached) framebuffer back page and between cached buffers
+ */
+void blitbench()
+{
+	const struct fb_state *fb = fb_info();
+	static char *names[] = {"fill fb", "fill RAM", "copy RAM->fb", "copy RAM->RAM"};
+	static void (*fills[])(unsigned int *, unsigned long, unsigned int) = {
+		blit_fill_scalar, blit_fill_64, blit_fill_neon};
+	static void (*copies[])(unsigned int *, const unsigned int *, unsigned long) = {
+		blit_copy_scalar, blit_copy_64, blit_copy_neon};
+	unsigned long n = (unsigned long)fb->height * fb->pitch / 4; // one page
+
+	if (!fb->base)
+	{
+		uart_puts("No frame buffer.\n");
+		return;
+	}
+	unsigned int *ram = cma_alloc(2 * n * 4, CMA_PAGE);
+	if (!ram)
+	{
+		uart_puts("Not enough contiguous memory.\n");
+		return;
+	}
+
+	uint64_t start = bench_begin("Fill and copy of one page (Mpixel/s)");
+	uart_dec(n);
+	uart_puts(" pixels\n");
+	uart_puts("         Kernel   scalar   64-bit     NEON\n");
+
+	// The hidden page, not the back buffer (which may be cached RAM)
+	unsigned int *fbp = (unsigned int *)(fb->base + (fb->pages == 2 ? (fb->front ^ 1) * fb->height * fb->pitch : 0));
+	unsigned int *dst[] = {fbp, ram, fbp, ram + n};
+	const unsigned int *src[] = {0, 0, ram, ram};
+
+	for (int t = 0; t < 4; t++)
+	{
+		bench_print_label(names[t], 15);
+		for (int k = 0; k < 3; k++)
+			bench_print_tenths(blit_rate(fills[k], copies[k], dst[t], src[t], n), 9);
+		uart_puts("\n");
+	}
+
+	bench_end(start);
+	cma_free(ram);
+	fb_dirty(0, 0, fb->width - 1, fb->height - 1); // the hidden page was overwritten
+	uart_puts("\n");
+}
+
+/* Printable ASCII, drawn as one pass of glyphbench */
+#define GLYPH_FIRST 32
+#define GLYPH_COUNT 96
+#define GLYPH_PASSES 20
+
+/*
+ * Thousands of glyphs per second drawing the printable characters passes
+ * times, emptying the glyph cache before each pass if cold is set
+ */
+static unsigned long glyph_rate(void (*fn)(unsigned char, int, int, unsigned char), int cold)
+{
+	const struct fb_state *fb = fb_info();
+	int cols = fb->width / 8;
+
+	uint64_t start = timer_counter();
+	for (int p = 0; p < GLYPH_PASSES; p++)
+	{
+		if (cold)
+			glyph_cache_flush();
+		for (int i = 0; i < GLYPH_COUNT; i++)
+			fn(GLYPH_FIRST + i, (i % cols) * 8, (i / cols) * 8, 0x0f);
+	}
+	unsigned long ns = timer_ticks_to_ns(timer_counter() - start);
+	return ns ? (unsigned long)GLYPH_PASSES * GLYPH_COUNT * 1000000 / ns : 0;
+}
+
+/*
+ * Thousands of glyphs per second drawing line, a full screen width of
+ * cached glyphs, reps times
+ */
+static unsigned long line_rate(void (*fn)(int, int, char *, unsigned char), char *line, int len, int reps)
+{
+	uint64_t start = timer_counter();
+	for (int r = 0; r < reps; r++)
+		fn(0, 16, line, 0x0f);
+	unsigned long ns = timer_ticks_to_ns(timer_counter() - start);
+	return ns ? (unsigned long)reps * len * 1000000 / ns : 0;
+}
+
+static void draw_char_mono(unsigned char ch, int x, int y, unsigned char attr)
+{
+	drawChar_mono(ch, x, y, attr, 0);
+}
+
+/**
+ * Text rendering speed: the original bit-by-bit drawChar, NEON expansion
+ * straight from the font, and the glyph cache with every glyph missing
+ * (expanded on the fly) and hitting
+ */
+void glyphbench()
+{
+	static char *names[] = {"per-pixel", "mono expand", "cache miss", "cache hit"};
+	const struct glyph_stats *stats = glyph_cache_stats();
+
+	uint64_t start = bench_begin("Drawing 8x8 glyphs to the back page (thousand glyphs/s)");
+	uart_dec(GLYPH_PASSES * GLYPH_COUNT);
+	uart_puts(" glyphs per method\n");
+
+	unsigned long rate[4];
+	rate[0] = glyph_rate(drawChar_pixelwise, 0);
+	rate[1] = glyph_rate(draw_char_mono, 0);
+	rate[2] = glyph_rate(drawChar, 1);
+	glyph_rate(drawChar, 0); // load every glyph once
+	rate[3] = glyph_rate(drawChar, 0);
+
+	for (int t = 0; t < 4; t++)
+	{
+		bench_print_label(names[t], 12);
+		bench_print_col(rate[t], 9);
+		uart_puts("\n");
+	}
+
+	// A full line of text, glyph by glyph against one scanline at a time
+	static char line[TEXT_RUN_MAX + 1];
+	const struct fb_state *fb = fb_info();
+	int len = fb->width / 8 < TEXT_RUN_MAX ? fb->width / 8 : TEXT_RUN_MAX;
+	for (int i = 0; i < len; i++)
+		line[i] = GLYPH_FIRST + i % GLYPH_COUNT;
+	line[len] = 0;
+
+	unsigned long glyphwise = line_rate(drawString_glyphwise, line, len, GLYPH_PASSES * 4);
+	unsigned long rowwise = line_rate(drawString, line, len, GLYPH_PASSES * 4);
+	uart_puts("Line of ");
+	uart_dec(len);
+	uart_puts(" characters:\n");
+	bench_print_label("glyph order", 12);
+	bench_print_col(glyphwise, 9);
+	uart_puts("\n");
+	bench_print_label("row order", 12);
+	bench_print_col(rowwise, 9);
+	uart_puts("\n");
+	uart_puts("Glyph cache: ");
+	uart_dec(stats->tiles);
+	uart_puts(" tiles of ");
+	uart_dec(GLYPH_CACHE_SIZE);
+	uart_puts(", ");
+	uart_dec(stats->hits);
+	uart_puts(" hits, ");
+	uart_dec(stats->misses);
+	uart_puts(" misses, ");
+	uart_dec(stats->evictions);
+	uart_puts(" evictions since boot\n");
+	bench_end(start);
+	uart_puts("\n");
+}
+
+/* Lines drawn per linebench measurement, and their length */
+#define LINE_COUNT 256
+#define LINE_LEN 255
+
+enum
+{
+	LINE_SHALLOW,
+	LINE_STEEP,
+	LINE_HORIZONTAL,
+	LINE_VERTICAL,
+	LINE_CLIPPED,
+	LINE_KINDS
+};
+
+/*
+ * Lines per second drawing LINE_COUNT lines of one kind, spread over the
+ * top left of the screen; clipped lines cross the whole screen from
+ * beyond its left edge to beyond its right one
+ */
+static unsigned long segment_rate(void (*fn)(int, int, int, int, unsigned char), int kind)
+{
+	const struct fb_state *fb = fb_info();
+
+	uint64_t start = timer_counter();
+	for (int i = 0; i < LINE_COUNT; i++)
+	{
+		int x = i % 64, y = i % 128, d = i % LINE_LEN;
+		if (kind == LINE_SHALLOW)
+			fn(x, y, x + LINE_LEN, y + d / 2, i);
+		else if (kind == LINE_STEEP)
+			fn(x, y, x + d / 2, y + LINE_LEN, i);
+		else if (kind == LINE_HORIZONTAL)
+			fn(x, y, x + LINE_LEN, y, i);
+		else if (kind == LINE_VERTICAL)
+			fn(x, y, x, y + LINE_LEN, i);
+		else
+			fn(-(int)fb->width / 2, y, fb->width + fb->width / 2, fb->height - y, i);
+	}
+	unsigned long ns = timer_ticks_to_ns(timer_counter() - start);
+	return ns ? (unsigned long)LINE_COUNT * 1000000000UL / ns : 0;
+}
+
+/**
+ * Line drawing: the original first-octant drawLine against the clipped
+ * all-octant Bresenham version, in lines per second
+ */
+void linebench()
+{
+	static char *names[] = {"shallow", "steep", "horizontal", "vertical", "clipped"};
+	// Kinds the original routine draws at all (x1 < x2, slope 0 to 1, on screen)
+	static const int old_ok[] = {1, 0, 1, 0, 0};
+
+	uint64_t start = bench_begin("Drawing lines to the back page (lines/s)");
+	uart_dec(LINE_COUNT);
+	uart_puts(" lines of ");
+	uart_dec(LINE_LEN + 1);
+	uart_puts(" pixels per kind\n");
+	uart_puts("        Kind  per-pixel  Bresenham\n");
+
+	for (int k = 0; k < LINE_KINDS; k++)
+	{
+		bench_print_label(names[k], 12);
+		if (old_ok[k])
+			bench_print_col(segment_rate(drawLine_pixelwise, k), 11);
+		else
+			bench_print_label("-", 11);
+		bench_print_col(segment_rate(drawLine, k), 11);
+		uart_puts("\n");
+	}
+	bench_end(start);
+	uart_puts("\n");
+}
+
+/* Shapes timed by shapebench, centred at (SHAPE_C, SHAPE_C) */
+#define SHAPE_C 300
+#define SHAPE_REPS 16
+
+enum
+{
+	SHAPE_CIRCLE_BIG,
+	SHAPE_CIRCLE_SMALL,
+	SHAPE_CIRCLE_OUTLINE,
+	SHAPE_ELLIPSE,
+	SHAPE_ROUND_RECT,
+	SHAPE_KINDS
+};
+
+/*
+ * Average time of one shape of the given kind in ns, drawn with the
+ * original line-filled circle if old is set
+ */
+static unsigned long shape_time(int kind, int old)
+{
+	uint64_t start = timer_counter();
+	for (int i = 0; i < SHAPE_REPS; i++)
+	{
+		unsigned char attr = 0x1e + (i & 0x0f) * 0x10;
+		void (*circle)(int, int, int, unsigned char, int) = old ? drawCircle_lines : drawCircle;
+
+		if (kind == SHAPE_CIRCLE_BIG)
+			circle(SHAPE_C, SHAPE_C, 250, attr, 1);
+		else if (kind == SHAPE_CIRCLE_SMALL)
+			circle(SHAPE_C, SHAPE_C, 30, attr, 1);
+		else if (kind == SHAPE_CIRCLE_OUTLINE)
+			circle(SHAPE_C, SHAPE_C, 250, attr, 0);
+		else if (kind == SHAPE_ELLIPSE)
+			drawEllipse(SHAPE_C, SHAPE_C, 280, 140, attr, 1);
+		else
+			drawRoundRect(SHAPE_C - 280, SHAPE_C - 140, SHAPE_C + 280, SHAPE_C + 140, 40, attr, 1);
+	}
+	return timer_ticks_to_ns(timer_counter() - start) / SHAPE_REPS;
+}
+
+/**
+ * Filled and outlined circles drawn by the original routine (overlapping
+ * line fills) against the span-filled shapes, plus the new ellipse and
+ * rounded rectangle, in us per shape
+ */
+void shapebench()
+{
+	static char *names[] = {"circle 250", "circle 30", "outline 250", "ellipse", "round rect"};
+	static const int has_old[] = {1, 1, 1, 0, 0};
+
+	uint64_t start = bench_begin("Shapes drawn to the back page (us/shape)");
+	uart_puts("        Shape      lines      spans  speedup\n");
+
+	for (int k = 0; k < SHAPE_KINDS; k++)
+	{
+		unsigned long new_ns = shape_time(k, 0);
+
+		bench_print_label(names[k], 13);
+		if (has_old[k])
+		{
+			unsigned long old_ns = shape_time(k, 1);
+			bench_print_tenths(old_ns / 100, 11);
+			bench_print_tenths(new_ns / 100, 11);
+			bench_print_tenths(new_ns ? old_ns * 10 / new_ns : 0, 8);
+			uart_puts("x\n");
+		}
+		else
+		{
+			bench_print_label("-", 11);
+			bench_print_tenths(new_ns / 100, 11);
+			uart_puts("\n");
+		}
+	}
+	bench_end(start);
+	uart_puts("\n");
+}
+
@@ -0,0 +1,21 @@
+// -----------------------------------bench.h -------------------------------------
+#include "./gcclib/stdint.h"
+
+/* Column helpers shared by the benchmark commands */
+void bench_print_col(unsigned long v, int width);
+void bench_print_label(char *s, int width);
+void bench_print_tenths(unsigned long tenths, int width);
+void bench_print_size(unsigned long bytes, int width);
+uint64_t bench_begin(char *title);
+void bench_end(uint64_t start);
+
+/* Benchmark commands */
+void membench(unsigned int ncores);
+void strbench();
+void mboxbench(unsigned int n);
+void flipbench(unsigned int n);
+void fillbench();
+void blitbench();
+void glyphbench();
+void linebench();
+void shapebench();
@@ -0,0 +1,300 @@
+// -----------------------------------blit.c -------------------------------------
+#include "blit.h"
+#include "./gcclib/stdint.h"
+
+/*
+ * The NEON kernels move 64 bytes (16 pixels) per iteration. Loads use LD1,
+ * which takes any alignment; stores are aligned to 16 bytes first and use
+ * STNP, a non-temporal hint that stops large fills and copies from
+ * evicting the working set (the framebuffer itself is not cached anyway).
+ * Unaligned NEON accesses need normal memory, i.e. the MMU must be on.
+ */
+#define BLOCK_PIXELS 16
+
+/* ------------------------------- fill ------------------------------- */
+
+void blit_fill_scalar(unsigned int *dst, unsigned long n, unsigned int color)
+{
+	while (n--)
+		*dst++ = color;
+}
+
+/**
+ * Pairs of 64-bit stores once dst is 16-byte aligned
+ */
+void blit_fill_64(unsigned int *dst, unsigned long n, unsigned int color)
+{
+	for (; n && ((uintptr_t)dst & 15); n--)
+		*dst++ = color;
+
+	unsigned long pattern = color | ((unsigned long)color << 32);
+	unsigned long *w = (unsigned long *)dst;
+	for (; n >= 4; n -= 4, w += 2)
+	{
+		w[0] = pattern;
+		w[1] = pattern;
+	}
+
+	for (dst = (unsigned int *)w; n; n--)
+		*dst++ = color;
+}
+
+void blit_fill_neon(unsigned int *dst, unsigned long n, unsigned int color)
+{
+	for (; n && ((uintptr_t)dst & 15); n--)
+		*dst++ = color;
+
+	unsigned long blocks = n / BLOCK_PIXELS;
+	if (blocks)
+	{
+		asm volatile("dup v0.4s, %w[c]\n"
+					 "mov v1.16b, v0.16b\n"
+					 "1: stnp q0, q1, [%[d]]\n"
+					 "stnp q0, q1, [%[d], #32]\n"
+					 "add %[d], %[d], #64\n"
+					 "subs %[b], %[b], #1\n"
+					 "b.ne 1b"
+					 : [d] "+r"(dst), [b] "+r"(blocks)
+					 : [c] "r"(color)
+					 : "v0", "v1", "cc", "memory");
+	}
+
+	for (n %= BLOCK_PIXELS; n; n--)
+		*dst++ = color;
+}
+
+void blit_fill(unsigned int *dst, unsigned long n, unsigned int color)
+{
+	blit_fill_neon(dst, n, color);
+}
+
+/* ------------------------------- copy ------------------------------- */
+
+void blit_copy_scalar(unsigned int *dst, const unsigned int *src, unsigned long n)
+{
+	while (n--)
+		*dst++ = *src++;
+}
+
+/**
+ * 64-bit copy when source and destination share their 8-byte alignment
+ */
+void blit_copy_64(unsigned int *dst, const unsigned int *src, unsigned long n)
+{
+	if ((((uintptr_t)dst ^ (uintptr_t)src) & 7) == 0)
+	{
+		if (n && ((uintptr_t)dst & 7))
+		{
+			*dst++ = *src++;
+			n--;
+		}
+
+		unsigned long *d = (unsigned long *)dst;
+		const unsigned long *s = (const unsigned long *)src;
+		for (; n >= 4; n -= 4, d += 2, s += 2)
+		{
+			unsigned long a = s[0], b = s[1];
+			d[0] = a;
+			d[1] = b;
+		}
+		dst = (unsigned int *)d;
+		src = (const unsigned int *)s;
+	}
+	blit_copy_scalar(dst, src, n);
+}
+
+/**
+ * Non-overlapping copy (or dst below src, see blit_move)
+ */
+void blit_copy_neon(unsigned int *dst, const unsigned int *src, unsigned long n)
+{
+	for (; n && ((uintptr_t)dst & 15); n--)
+		*dst++ = *src++;
+
+	unsigned long blocks = n / BLOCK_PIXELS;
+	if (blocks)
+	{
+		asm volatile("1: ld1 {v0.4s-v3.4s}, [%[s]], #64\n"
+					 "stnp q0, q1, [%[d]]\n"
+					 "stnp q2, q3, [%[d], #32]\n"
+					 "add %[d], %[d], #64\n"
+					 "subs %[b], %[b], #1\n"
+					 "b.ne 1b"
+					 : [d] "+r"(dst), [s] "+r"(src), [b] "+r"(blocks)
+					 :
+					 : "v0", "v1", "v2", "v3", "cc", "memory");
+	}
+
+	blit_copy_scalar(dst, src, n % BLOCK_PIXELS);
+}
+
+void blit_copy(unsigned int *dst, const unsigned int *src, unsigned long n)
+{
+	blit_copy_neon(dst, src, n);
+}
+
+/**
+ * Copy between ranges that may overlap (scrolling inside one buffer).
+ * Each block is loaded whole before it is stored, so copying forwards
+ * is safe when dst is below src and backwards when it is above.
+ */
+void blit_move(unsigned int *dst, const unsigned int *src, unsigned long n)
+{
+	if (dst <= src || dst >= src + n)
+	{
+		blit_copy_neon(dst, src, n);
+		return;
+	}
+
+	dst += n;
+	src += n;
+	for (; n % BLOCK_PIXELS; n--)
+		*--dst = *--src;
+
+	unsigned long blocks = n / BLOCK_PIXELS;
+	if (blocks)
+	{
+		asm volatile("1: sub %[s], %[s], #64\n"
+					 "sub %[d], %[d], #64\n"
+					 "ld1 {v0.4s-v3.4s}, [%[s]]\n"
+					 "st1 {v0.4s-v3.4s}, [%[d]]\n"
+					 "subs %[b], %[b], #1\n"
+					 "b.ne 1b"
+					 : [d] "+r"(dst), [s] "+r"(src), [b] "+r"(blocks)
+					 :
+					 : "v0", "v1", "v2", "v3", "cc", "memory");
+	}
+}
+
+/**
+ * Copy a w x h pixel block between two images with their own pitches
+ */
+void blit_copy_2d(unsigned char *dst, unsigned long dst_pitch, const unsigned char *src,
+				  unsigned long src_pitch, unsigned long w, unsigned long h)
+{
+	// Both images contiguous: one long copy
+	if (dst_pitch == w * 4 && src_pitch == w * 4)
+	{
+		blit_copy_neon((unsigned int *)dst, (const unsigned int *)src, w * h);
+		return;
+	}
+	for (; h; h--, dst += dst_pitch, src += src_pitch)
+		blit_copy_neon((unsigned int *)dst, (const unsigned int *)src, w);
+}
+
+/* ------------------------------- mono ------------------------------- */
+
+/*
+ * 1-bpp rows are expanded with bit 0 of each byte as the leftmost pixel,
+ * the layout of the font table. Opaque writes fg for set bits and bg for
+ * clear ones; transparent leaves the pixels under clear bits alone.
+ */
+
+void blit_mono_scalar(unsigned int *dst, const unsigned char *bits, unsigned int bit, unsigned long n,
+					  unsigned int fg, unsigned int bg, int transparent)
+{
+	bits += bit >> 3;
+	bit &= 7;
+	for (; n; n--, dst++)
+	{
+		if ((*bits >> bit) & 1)
+			*dst = fg;
+		else if (!transparent)
+			*dst = bg;
+		if (++bit == 8)
+		{
+			bit = 0;
+			bits++;
+		}
+	}
+}
+
+/* Lane masks selecting bit i of a 16-bit row chunk for pixel i */
+static const unsigned int mono_lanes[16] __attribute__((aligned(16))) = {
+	1 << 0, 1 << 1, 1 << 2, 1 << 3, 1 << 4, 1 << 5, 1 << 6, 1 << 7,
+	1 << 8, 1 << 9, 1 << 10, 1 << 11, 1 << 12, 1 << 13, 1 << 14, 1 << 15};
+
+/**
+ * 16 pixels per iteration: two mask bytes are broadcast to every lane,
+ * CMTST turns each lane's bit into an all-ones or all-zeros lane, and BSL
+ * picks fg or the background (bg, or the pixels already there) with it
+ */
+void blit_mono_neon(unsigned int *dst, const unsigned char *bits, unsigned int bit, unsigned long n,
+					unsigned int fg, unsigned int bg, int transparent)
+{
+	// Step to a byte boundary in the mask
+	bits += bit >> 3;
+	bit &= 7;
+	if (bit)
+	{
+		unsigned long head = 8 - bit < n ? 8 - bit : n;
+		blit_mono_scalar(dst, bits, bit, head, fg, bg, transparent);
+		dst += head;
+		bits++;
+		n -= head;
+	}
+
+	unsigned long blocks = n / BLOCK_PIXELS;
+	unsigned long t0, t1;
+	if (blocks)
+	{
+		if (transparent)
+		{
+			asm volatile("ld1 {v4.4s-v7.4s}, [%[l]]\n"
+						 "dup v16.4s, %w[f]\n"
+						 "1: ldrb %w[t0], [%[m]], #1\n"
+						 "ldrb %w[t1], [%[m]], #1\n"
+						 "orr %w[t0], %w[t0], %w[t1], lsl #8\n"
+						 "dup v18.4s, %w[t0]\n"
+						 "ld1 {v20.4s-v23.4s}, [%[d]]\n"
+						 "cmtst v0.4s, v18.4s, v4.4s\n"
+						 "cmtst v1.4s, v18.4s, v5.4s\n"
+						 "cmtst v2.4s, v18.4s, v6.4s\n"
+						 "cmtst v3.4s, v18.4s, v7.4s\n"
+						 "bsl v0.16b, v16.16b, v20.16b\n"
+						 "bsl v1.16b, v16.16b, v21.16b\n"
+						 "bsl v2.16b, v16.16b, v22.16b\n"
+						 "bsl v3.16b, v16.16b, v23.16b\n"
+						 "st1 {v0.4s-v3.4s}, [%[d]], #64\n"
+						 "subs %[b], %[b], #1\n"
+						 "b.ne 1b"
+						 : [d] "+r"(dst), [m] "+r"(bits), [b] "+r"(blocks), [t0] "=&r"(t0), [t1] "=&r"(t1)
+						 : [l] "r"(mono_lanes), [f] "r"(fg)
+						 : "v0", "v1", "v2", "v3", "v4", "v5", "v6", "v7", "v16", "v18", "v20", "v21", "v22", "v23",
+						   "cc", "memory");
+		}
+		else
+		{
+			asm volatile("ld1 {v4.4s-v7.4s}, [%[l]]\n"
+						 "dup v16.4s, %w[f]\n"
+						 "dup v17.4s, %w[g]\n"
+						 "1: ldrb %w[t0], [%[m]], #1\n"
+						 "ldrb %w[t1], [%[m]], #1\n"
+						 "orr %w[t0], %w[t0], %w[t1], lsl #8\n"
+						 "dup v18.4s, %w[t0]\n"
+						 "cmtst v0.4s, v18.4s, v4.4s\n"
+						 "cmtst v1.4s, v18.4s, v5.4s\n"
+						 "cmtst v2.4s, v18.4s, v6.4s\n"
+						 "cmtst v3.4s, v18.4s, v7.4s\n"
+						 "bsl v0.16b, v16.16b, v17.16b\n"
+						 "bsl v1.16b, v16.16b, v17.16b\n"
+						 "bsl v2.16b, v16.16b, v17.16b\n"
+						 "bsl v3.16b, v16.16b, v17.16b\n"
+						 "st1 {v0.4s-v3.4s}, [%[d]], #64\n"
+						 "subs %[b], %[b], #1\n"
+						 "b.ne 1b"
+						 : [d] "+r"(dst), [m] "+r"(bits), [b] "+r"(blocks), [t0] "=&r"(t0), [t1] "=&r"(t1)
+						 : [l] "r"(mono_lanes), [f] "r"(fg), [g] "r"(bg)
+						 : "v0", "v1", "v2", "v3", "v4", "v5", "v6", "v7", "v16", "v17", "v18", "cc", "memory");
+		}
+	}
+
+	blit_mono_scalar(dst, bits, 0, n % BLOCK_PIXELS, fg, bg, transparent);
+}
+
+void blit_mono(unsigned int *dst, const unsigned char *bits, unsigned int bit, unsigned long n,
+			   unsigned int fg, unsigned int bg, int transparent)
+{
+	blit_mono_neon(dst, bits, bit, n, fg, bg, transparent);
+}
+
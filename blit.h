@@ -0,0 +1,22 @@
+// -----------------------------------blit.h -------------------------------------
+/* Pixel fill and copy kernels (32-bit pixels, counts in pixels, pitches in bytes) */
+
+void blit_fill(unsigned int *dst, unsigned long n, unsigned int color);
+void blit_copy(unsigned int *dst, const unsigned int *src, unsigned long n);
+void blit_move(unsigned int *dst, const unsigned int *src, unsigned long n);
+void blit_copy_2d(unsigned char *dst, unsigned long dst_pitch, const unsigned char *src,
+				  unsigned long src_pitch, unsigned long w, unsigned long h);
+void blit_mono(unsigned int *dst, const unsigned char *bits, unsigned int bit, unsigned long n,
+			   unsigned int fg, unsigned int bg, int transparent);
+
+/* Individual implementations, exposed for blitbench */
+void blit_fill_scalar(unsigned int *dst, unsigned long n, unsigned int color);
+void blit_fill_64(unsigned int *dst, unsigned long n, unsigned int color);
+void blit_fill_neon(unsigned int *dst, unsigned long n, unsigned int color);
+void blit_copy_scalar(unsigned int *dst, const unsigned int *src, unsigned long n);
+void blit_copy_64(unsigned int *dst, const unsigned int *src, unsigned long n);
+void blit_copy_neon(unsigned int *dst, const unsigned int *src, unsigned long n);
+void blit_mono_scalar(unsigned int *dst, const unsigned char *bits, unsigned int bit, unsigned long n,
+					  unsigned int fg, unsigned int bg, int transparent);
+void blit_mono_neon(unsigned int *dst, const unsigned char *bits, unsigned int bit, unsigned long n,
+					unsigned int fg, unsigned int bg, int transparent);
@@ -0,0 +1,129 @@
+// -----------------------------------board.c -------------------------------------
+#include "board.h"
+#include "mbox.h"
+#include "timer.h"
+#include "uart1.h"
+
+static struct board_info info;
+
+/* Clock rate cache: value and the counter time it expires at */
+static unsigned int clock_rate[CLOCK_MAX_ID];
+static uint64_t clock_expiry[CLOCK_MAX_ID];
+
+/**
+ * Fetch model, revision, MAC, serial and the memory split in a single
+ * batched mailbox query
+ */
+void board_info_init()
+{
+	struct mbox_msg msg;
+	mbox_msg_begin(&msg);
+	int model = mbox_msg_add(&msg, MBOX_TAG_GETMODEL, 0, 0, 1);
+	int revision = mbox_msg_add(&msg, MBOX_TAG_GETREVISION, 0, 0, 1);
+	int mac = mbox_msg_add(&msg, MBOX_TAG_GETMAC, 0, 0, 2);
+	int serial = mbox_msg_add(&msg, MBOX_TAG_GETSERIAL, 0, 0, 2);
+	int armmem = mbox_msg_add(&msg, MBOX_TAG_GETARMMEM, 0, 0, 2);
+	int vcmem = mbox_msg_add(&msg, MBOX_TAG_GETVCMEM, 0, 0, 2);
+
+	if (!mbox_msg_send(&msg))
+	{
+		mbox_msg_end(&msg);
+		return;
+	}
+
+	volatile unsigned int *value;
+	if ((value = mbox_msg_value(&msg, model)))
+		info.model = value[0];
+	if ((value = mbox_msg_value(&msg, revision)))
+		info.revision = value[0];
+	if ((value = mbox_msg_value(&msg, mac)))
+	{
+		volatile unsigned char *bytes = (volatile unsigned char *)value;
+		for (int i = 0; i < 6; i++)
+			info.mac[i] = bytes[i];
+	}
+	if ((value = mbox_msg_value(&msg, serial)))
+		info.serial = value[0] | ((unsigned long)value[1] << 32);
+	if ((value = mbox_msg_value(&msg, armmem)))
+	{
+		info.arm_base = value[0];
+		info.arm_size = value[1];
+	}
+	if ((value = mbox_msg_value(&msg, vcmem)))
+	{
+		info.vc_base = value[0];
+		info.vc_size = value[1];
+	}
+	info.valid = 1;
+	mbox_msg_end(&msg);
+}
+
+/**
+ * Cached board facts (valid is 0 if the boot query failed)
+ */
+const struct board_info *board_info()
+{
+	return &info;
+}
+
+/**
+ * Current rate of a clock in Hz (0 on failure), served from the cache
+ * while it is younger than CLOCK_CACHE_TTL_MS
+ */
+unsigned int board_clock_rate(unsigned int clock_id)
+{
+	if (clock_id >= CLOCK_MAX_ID)
+		return 0;
+
+	uint64_t now = timer_counter();
+	if (clock_rate[clock_id] && now < clock_expiry[clock_id])
+		return clock_rate[clock_id];
+
+	struct mbox_msg msg;
+	unsigned int request_values[] = {clock_id, 0};
+	mbox_msg_begin(&msg);
+	int clock = mbox_msg_add(&msg, MBOX_TAG_GETCLKRATE, request_values, 2, 2);
+	unsigned int rate = 0;
+	if (mbox_msg_send(&msg) && mbox_msg_value(&msg, clock))
+		rate = MBOX_VIEW(&msg, clock, struct mbox_clock)->rate;
+	mbox_msg_end(&msg);
+	if (!rate)
+		return 0;
+
+	clock_rate[clock_id] = rate;
+	clock_expiry[clock_id] = now + timer_frequency() * CLOCK_CACHE_TTL_MS / 1000;
+	return clock_rate[clock_id];
+}
+
+/**
+ * Drop cached clock rates (all of them if clock_id is 0). Changing one
+ * clock may move others (e.g. the core clock with the ARM clock).
+ */
+void board_clock_invalidate(unsigned int clock_id)
+{
+	for (unsigned int id = 0; id < CLOCK_MAX_ID; id++)
+		if (clock_id == 0 || id == clock_id)
+			clock_rate[id] = 0;
+}
+
+/**
+ * Set a clock rate through MBOX_TAG_SETCLKRATE and return the rate the
+ * firmware actually chose (0 on failure). All cached rates are invalidated
+ * and the UART divisor follows the new core clock.
+ */
+unsigned int board_set_clock_rate(unsigned int clock_id, unsigned int rate)
+{
+	struct mbox_msg msg;
+	unsigned int request_values[] = {clock_id, rate, 0}; // 0 = do not skip turbo setting
+	mbox_msg_begin(&msg);
+	int clock = mbox_msg_add(&msg, MBOX_TAG_SETCLKRATE, request_values, 3, 2);
+	unsigned int actual = 0;
+	if (mbox_msg_send(&msg) && mbox_msg_value(&msg, clock))
+		actual = MBOX_VIEW(&msg, clock, struct mbox_clock)->rate;
+	mbox_msg_end(&msg);
+
+	board_clock_invalidate(0);
+	// the mini UART divisor depends on the core clock
+	uart_clock_changed();
+	return actual;
+}
@@ -0,0 +1,34 @@
+// -----------------------------------board.h -------------------------------------
+#ifndef BOARD_H
+#define BOARD_H
+
+/* Clock ids for the clock rate tags */
+#define CLOCK_EMMC 1
+#define CLOCK_UART 2
+#define CLOCK_ARM 3
+#define CLOCK_CORE 4
+#define CLOCK_MAX_ID 16
+
+/* Clock rates are re-read from the firmware after this long (ms) */
+#define CLOCK_CACHE_TTL_MS 100
+
+/* Facts that never change at runtime, fetched once at boot */
+struct board_info
+{
+	int valid;
+	unsigned int model;
+	unsigned int revision;
+	unsigned char mac[6];
+	unsigned long serial;
+	unsigned int arm_base, arm_size; // ARM memory split
+	unsigned int vc_base, vc_size;	 // VideoCore memory split
+};
+
+/* Function prototypes */
+void board_info_init();
+const struct board_info *board_info();
+unsigned int board_clock_rate(unsigned int clock_id);
+unsigned int board_set_clock_rate(unsigned int clock_id, unsigned int rate);
+void board_clock_invalidate(unsigned int clock_id);
+
+#endif
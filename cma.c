@@ -0,0 +1,183 @@
+// -----------------------------------cma.c -------------------------------------
+#include "cma.h"
+
+extern char __cma_start[], __cma_end[];
+
+/* Free and allocated ranges are kept in small address-ordered tables, so
+ * every operation is a short linear scan no matter how the region is used */
+#define CMA_MAX_EXTENTS 64
+
+struct cma_extent
+{
+	unsigned long base;
+	unsigned long size;
+};
+
+static struct cma_extent free_list[CMA_MAX_EXTENTS];
+static int num_free = -1; // -1 until the region is set up
+static struct cma_extent used_list[CMA_MAX_EXTENTS];
+static int num_used;
+
+static void cma_setup()
+{
+	free_list[0].base = (unsigned long)__cma_start;
+	free_list[0].size = __cma_end - __cma_start;
+	num_free = 1;
+	num_used = 0;
+}
+
+static void remove_extent(struct cma_extent *list, int *count, int i)
+{
+	for (; i < *count - 1; i++)
+		list[i] = list[i + 1];
+	(*count)--;
+}
+
+static int insert_extent(struct cma_extent *list, int *count, int i, unsigned long base, unsigned long size)
+{
+	if (*count == CMA_MAX_EXTENTS)
+		return 0;
+	for (int j = *count; j > i; j--)
+		list[j] = list[j - 1];
+	list[i].base = base;
+	list[i].size = size;
+	(*count)++;
+	return 1;
+}
+
+/**
+ * Allocate size bytes (rounded up to CMA_PAGE) aligned to align (a power of
+ * two, at least CMA_PAGE). Picks the free range that leaves the smallest
+ * remainder (best fit), so large holes stay available for large requests.
+ * Returns 0 if no range fits.
+ */
+void *cma_alloc(unsigned long size, unsigned long align)
+{
+	if (num_free < 0)
+		cma_setup();
+	if (size == 0 || num_used == CMA_MAX_EXTENTS)
+		return 0;
+
+	size = (size + CMA_PAGE - 1) & ~(CMA_PAGE - 1UL);
+	if (align < CMA_PAGE)
+		align = CMA_PAGE;
+
+	int best = -1;
+	unsigned long best_start = 0, best_waste = ~0UL;
+	for (int i = 0; i < num_free; i++)
+	{
+		unsigned long start = (free_list[i].base + align - 1) & ~(align - 1);
+		unsigned long end = free_list[i].base + free_list[i].size;
+		if (start + size > end)
+			continue;
+
+		unsigned long waste = free_list[i].size - size;
+		if (waste < best_waste)
+		{
+			best = i;
+			best_start = start;
+			best_waste = waste;
+		}
+	}
+	if (best < 0)
+		return 0;
+
+	// Split the chosen range into [head][allocation][tail]
+	unsigned long base = free_list[best].base;
+	unsigned long end = base + free_list[best].size;
+	unsigned long head = best_start - base;
+	unsigned long tail = end - (best_start + size);
+
+	if (head && tail && num_free == CMA_MAX_EXTENTS)
+		return 0; // no room to track both leftovers
+
+	remove_extent(free_list, &num_free, best);
+	if (tail)
+		insert_extent(free_list, &num_free, best, best_start + size, tail);
+	if (head)
+		insert_extent(free_list, &num_free, best, base, head);
+
+	int u = 0;
+	while (u < num_used && used_list[u].base < best_start)
+		u++;
+	insert_extent(used_list, &num_used, u, best_start, size);
+
+	return (void *)best_start;
+}
+
+/**
+ * Return a buffer to the region, merging it with free neighbours. Returns 0
+ * if ptr was not allocated, or if the free list has no room for a range that
+ * touches no free neighbour; the buffer then stays allocated rather than
+ * being lost, and the call can be repeated once other buffers are freed.
+ */
+int cma_free(void *ptr)
+{
+	unsigned long base = (unsigned long)ptr;
+	int u;
+
+	for (u = 0; u < num_used; u++)
+		if (used_list[u].base == base)
+			break;
+	if (u == num_used)
+		return 0;
+
+	unsigned long size = used_list[u].size;
+
+	int i = 0;
+	while (i < num_free && free_list[i].base < base)
+		i++;
+
+	int merge_prev = i > 0 && free_list[i - 1].base + free_list[i - 1].size == base;
+	int merge_next = i < num_free && base + size == free_list[i].base;
+
+	if (!merge_prev && !merge_next && num_free == CMA_MAX_EXTENTS)
+		return 0; // keep it tracked as used instead of dropping the range
+
+	remove_extent(used_list, &num_used, u);
+
+	if (merge_prev && merge_next)
+	{
+		free_list[i - 1].size += size + free_list[i].size;
+		remove_extent(free_list, &num_free, i);
+	}
+	else if (merge_prev)
+		free_list[i - 1].size += size;
+	else if (merge_next)
+	{
+		free_list[i].base = base;
+		free_list[i].size += size;
+	}
+	else
+		insert_extent(free_list, &num_free, i, base, size);
+	return 1;
+}
+
+/**
+ * Total free bytes in the region
+ */
+unsigned long cma_free_bytes()
+{
+	if (num_free < 0)
+		cma_setup();
+
+	unsigned long total = 0;
+	for (int i = 0; i < num_free; i++)
+		total += free_list[i].size;
+	return total;
+}
+
+/**
+ * Size of the largest free range
+ */
+unsigned long cma_largest_free()
+{
+	if (num_free < 0)
+		cma_setup();
+
+	unsigned long largest = 0;
+	for (int i = 0; i < num_free; i++)
+		if (free_list[i].size > largest)
+			largest = free_list[i].size;
+	return largest;
+}
@@ -0,0 +1,13 @@
+// -----------------------------------cma.h -------------------------------------
+
+/* Contiguous memory allocator for multi-megabyte, physically contiguous
+ * buffers (frame buffers, back buffers, DMA blits) */
+
+#define CMA_PAGE 4096		   // allocation granule
+#define CMA_ALIGN_2M 0x200000 // alignment of large buffers (one MMU block)
+
+/* Function prototypes */
+void *cma_alloc(unsigned long size, unsigned long align);
+int cma_free(void *ptr);
+unsigned long cma_free_bytes();
+unsigned long cma_largest_free();
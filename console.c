@@ -0,0 +1,339 @@
+// -----------------------------------console.c -------------------------------------
+#include "console.h"
+#include "framebf.h"
+#include "blit.h"
+#include "timer.h"
+
+/*
+ * The console owns a single page mode with a virtual buffer several screens
+ * tall. Text is written straight into the virtual buffer below the visible
+ * window, and a new line at the bottom scrolls by moving the window down
+ * one text line (MBOX_TAG_SETVIRTOFF). Only when the window reaches the end
+ * of the buffer is the screen copied back to the top, once every
+ * (CONSOLE_SCREENS - 1) screens of output.
+ */
+static int active;
+static unsigned char *console_base; // frame buffer the console was set up on
+static unsigned int cols, rows; // character cells on screen
+static unsigned int vrows;		// text lines in the virtual buffer
+static unsigned int top;		// virtual line shown at the top of the screen
+static unsigned int cx, cy;		// cursor cell, cy counted from top
+static unsigned char attr = CONSOLE_ATTR;
+
+/* Characters written since the last draw, all on the cursor line */
+static char run[CONSOLE_MAX_COLS];
+static unsigned int run_col, run_len;
+
+/* Escape sequence parser */
+enum
+{
+	ESC_NONE,
+	ESC_START, // got ESC
+	ESC_CSI	   // got ESC [, reading parameters
+};
+static int esc_state;
+static unsigned int params[CONSOLE_PARAMS];
+static int nparams;
+
+static struct console_stats stats;
+
+/* ANSI color number to VGA palette index */
+static const unsigned char ansi_to_vga[8] = {0, 4, 2, 6, 1, 5, 3, 7};
+
+/*
+ * Paint n cells of virtual line vline from col with the background color
+ */
+static void clear_cells(unsigned int vline, unsigned int col, unsigned int n)
+{
+	const struct fb_state *fb = fb_info();
+	unsigned char *row = fb->base + vline * CHAR_HEIGHT * fb->pitch + col * CHAR_WIDTH * 4;
+	unsigned int color = fb_palette(attr >> 4);
+
+	for (int i = 0; i < CHAR_HEIGHT; i++, row += fb->pitch)
+		blit_fill((unsigned int *)row, n * CHAR_WIDTH, color);
+}
+
+static void clear_lines(unsigned int vline, unsigned int n)
+{
+	const struct fb_state *fb = fb_info();
+	blit_fill((unsigned int *)(fb->base + vline * CHAR_HEIGHT * fb->pitch),
+			  (unsigned long)n * CHAR_HEIGHT * fb->pitch / 4, fb_palette(attr >> 4));
+}
+
+/*
+ * Another mode set (an image viewer, expandscreen) takes the screen over
+ */
+static int still_owned()
+{
+	const struct fb_state *fb = fb_info();
+	if (fb->base != console_base || fb->pages != 1 || fb->virt_height != vrows * CHAR_HEIGHT)
+		active = 0;
+	return active;
+}
+
+/**
+ * Draw the characters written since the last call
+ */
+void console_flush()
+{
+	if (!run_len)
+		return;
+	if (!still_owned())
+	{
+		run_len = 0;
+		return;
+	}
+	drawTextVirtual(run_col, top + cy, run, run_len, attr);
+	run_len = 0;
+}
+
+static void new_line()
+{
+	const struct fb_state *fb = fb_info();
+
+	console_flush();
+	cx = 0;
+	stats.lines++;
+	if (cy + 1 < rows)
+	{
+		cy++;
+		return;
+	}
+
+	if (top + rows < vrows)
+	{
+		// Room below the window: show one more line of the buffer
+		top++;
+		clear_lines(top + rows - 1, 1);
+		fb_pan(0, top * CHAR_HEIGHT);
+		stats.pans++;
+		return;
+	}
+
+	// End of the buffer: copy all but the top line back to the start
+	uint64_t start = timer_counter();
+	blit_copy((unsigned int *)fb->base, (const unsigned int *)(fb->base + (top + 1) * CHAR_HEIGHT * fb->pitch),
+			  (unsigned long)(rows - 1) * CHAR_HEIGHT * fb->pitch / 4);
+	top = 0;
+	clear_lines(rows - 1, 1);
+	fb_pan(0, 0);
+	stats.wraps++;
+	stats.wrap_us = timer_ticks_to_us(timer_counter() - start);
+}
+
+static void put_char(char c)
+{
+	if (cx >= cols)
+		new_line();
+	if (run_len && run_col + run_len != cx)
+		console_flush();
+	if (!run_len)
+		run_col = cx;
+	run[run_len++] = c;
+	cx++;
+}
+
+/*
+ * Select Graphic Rendition (ESC [ ... m): the colors setcolor emits
+ */
+static void set_rendition()
+{
+	if (!nparams)
+		params[nparams++] = 0;
+
+	for (int i = 0; i < nparams; i++)
+	{
+		unsigned int p = params[i];
+		if (p == 0)
+			attr = CONSOLE_ATTR;
+		else if (p == 1)
+			attr |= 0x08; // bold: bright foreground
+		else if (p >= 30 && p <= 37)
+			attr = (attr & 0xf8) | ansi_to_vga[p - 30];
+		else if (p == 39)
+			attr = (attr & 0xf0) | (CONSOLE_ATTR & 0x0f);
+		else if (p >= 40 && p <= 47)
+			attr = (attr & 0x0f) | ansi_to_vga[p - 40] << 4;
+		else if (p == 49)
+			attr = (attr & 0x0f) | (CONSOLE_ATTR & 0xf0);
+		else if (p >= 90 && p <= 97)
+			attr = (attr & 0xf0) | ansi_to_vga[p - 90] | 0x08;
+		else if (p >= 100 && p <= 107)
+			attr = (attr & 0x0f) | (ansi_to_vga[p - 100] | 0x08) << 4;
+	}
+}
+
+static void control_sequence(char final)
+{
+	unsigned int p0 = nparams ? params[0] : 0;
+
+	console_flush();
+	switch (final)
+	{
+	case 'm':
+		set_rendition();
+		break;
+	case 'H': // cursor position, 1-based row;col
+	case 'f':
+		cy = p0 ? p0 - 1 : 0;
+		cx = nparams > 1 && params[1] ? params[1] - 1 : 0;
+		cy = cy < rows ? cy : rows - 1;
+		cx = cx < cols ? cx : cols - 1;
+		break;
+	case 'J': // erase in display: 2 (and 3) the whole screen, 0 below the cursor
+		if (p0 >= 2)
+			clear_lines(top, rows);
+		else if (p0 == 0)
+		{
+			clear_cells(top + cy, cx, cols - cx);
+			if (cy + 1 < rows)
+				clear_lines(top + cy + 1, rows - cy - 1);
+		}
+		break;
+	case 'K': // erase in line, from the cursor
+		if (p0 == 0)
+			clear_cells(top + cy, cx, cols - cx);
+		break;
+	}
+}
+
+/**
+ * Interpret one character of UART output. Drawing is deferred until the
+ * cursor leaves the line or console_flush() is called.
+ */
+void console_putc(char c)
+{
+	if (!active || !still_owned())
+		return;
+
+	if (esc_state == ESC_START)
+	{
+		esc_state = (c == '[') ? ESC_CSI : ESC_NONE;
+		nparams = 0;
+		params[0] = 0;
+		return;
+	}
+	if (esc_state == ESC_CSI)
+	{
+		if (c >= '0' && c <= '9')
+		{
+			if (!nparams)
+				nparams = 1;
+			if (nparams <= CONSOLE_PARAMS)
+				params[nparams - 1] = params[nparams - 1] * 10 + (c - '0');
+		}
+		else if (c == ';')
+		{
+			if (!nparams)
+				nparams = 1;
+			if (nparams < CONSOLE_PARAMS)
+				params[nparams] = 0;
+			nparams++;
+		}
+		else if (c >= 0x40 && c <= 0x7e)
+		{
+			if (nparams > CONSOLE_PARAMS)
+				nparams = CONSOLE_PARAMS;
+			control_sequence(c);
+			esc_state = ESC_NONE;
+		}
+		return;
+	}
+
+	switch (c)
+	{
+	case '\033':
+		esc_state = ESC_START;
+		break;
+	case '\n':
+		new_line();
+		break;
+	case '\r':
+		console_flush();
+		cx = 0;
+		break;
+	case '\b':
+		console_flush();
+		if (cx)
+			cx--;
+		break;
+	case '\t':
+		do
+			put_char(' ');
+		while (cx % 8 && cx < cols);
+		break;
+	default:
+		if ((unsigned char)c >= ' ')
+			put_char(c);
+	}
+}
+
+/**
+ * Switch the screen to the console: a single page mode with a virtual
+ * buffer CONSOLE_SCREENS tall (fewer if the firmware refuses or grants
+ * less). Returns 0, back on the graphics screen, if not even two screens
+ * could be had.
+ */
+int console_enable()
+{
+	const struct fb_state *fb = fb_info();
+	unsigned int width = fb->width, height = fb->height;
+	unsigned int screens;
+
+	if (active)
+		return 1;
+	for (screens = CONSOLE_SCREENS; screens >= 2; screens /= 2)
+	{
+		// The firmware may grant less virtual height than asked for; with
+		// about one screen every new line would wrap and copy the screen
+		struct fb_mode mode = {width, height, width, screens * height, 0, 1};
+		if (fb_set_mode(&mode) && fb->virt_height >= screens * fb->height)
+			break;
+	}
+	if (screens < 2)
+	{
+		struct fb_mode mode = {width, height, 0, 0, 0, 2};
+		fb_set_mode(&mode);
+		clearScreen(0);
+		fb_present();
+		return 0;
+	}
+
+	cols = fb->width / CHAR_WIDTH < CONSOLE_MAX_COLS ? fb->width / CHAR_WIDTH : CONSOLE_MAX_COLS;
+	rows = fb->height / CHAR_HEIGHT;
+	vrows = fb->virt_height / CHAR_HEIGHT;
+	top = cx = cy = 0;
+	run_len = 0;
+	esc_state = ESC_NONE;
+	attr = CONSOLE_ATTR;
+	clear_lines(0, vrows);
+	console_base = fb->base;
+	active = 1;
+	return 1;
+}
+
+/**
+ * Back to the double buffered graphics screen, cleared
+ */
+void console_disable()
+{
+	if (!active)
+		return;
+	console_flush();
+	active = 0;
+
+	struct fb_mode mode = {fb_info()->width, fb_info()->height, 0, 0, 0, 2};
+	fb_set_mode(&mode);
+	clearScreen(0);
+	fb_present();
+}
+
+int console_active()
+{
+	return active;
+}
+
+const struct console_stats *console_stats()
+{
+	return &stats;
+}
@@ -0,0 +1,23 @@
+// -----------------------------------console.h -------------------------------------
+/* Framebuffer text console mirroring the UART output */
+
+#define CONSOLE_SCREENS 4	   // virtual buffer height in screens (scrollback before a wrap)
+#define CONSOLE_MAX_COLS 256   // widest text line handled
+#define CONSOLE_ATTR 0x07	   // light grey on black, as after ESC[0m
+#define CONSOLE_PARAMS 4	   // numeric parameters kept per escape sequence
+
+struct console_stats
+{
+	unsigned long lines; // new lines
+	unsigned long pans;	 // scrolls done by moving the virtual offset
+	unsigned long wraps; // scrolls that copied the screen back to the top
+	unsigned long wrap_us; // duration of the last wrap
+};
+
+/* Function prototypes */
+int console_enable();
+void console_disable();
+int console_active();
+void console_putc(char c);
+void console_flush();
+const struct console_stats *console_stats();
@@ -0,0 +1,154 @@
+// -----------------------------------cpufreq.c -------------------------------------
+#include "cpufreq.h"
+#include "board.h"
+#include "mbox.h"
+
+static unsigned int policy = CPUFREQ_ONDEMAND;
+static unsigned int min_rate, max_rate;
+static unsigned int pinned_rate;
+static unsigned int target_rate; // last rate asked from the firmware
+static unsigned int transitions;
+static int busy; // nesting depth of cpufreq_busy_begin()
+
+static char *policy_names[] = {"ondemand", "performance", "powersave", "pinned"};
+
+/*
+ * Ask the firmware for a new ARM clock, skipping the mailbox round trip
+ * when the rate is already in effect
+ */
+static void cpufreq_set_rate(unsigned int rate)
+{
+	if (!rate || rate == target_rate)
+		return;
+
+	unsigned int actual = board_set_clock_rate(CLOCK_ARM, rate);
+	if (actual)
+	{
+		target_rate = rate;
+		transitions++;
+	}
+}
+
+/* Rate the current policy wants right now */
+static unsigned int cpufreq_wanted_rate()
+{
+	switch (policy)
+	{
+	case CPUFREQ_PERFORMANCE:
+		return max_rate;
+	case CPUFREQ_POWERSAVE:
+		return min_rate;
+	case CPUFREQ_PINNED:
+		return pinned_rate;
+	default:
+		return busy ? max_rate : min_rate;
+	}
+}
+
+/**
+ * Read the ARM clock limits (one batched query) and apply the default
+ * on-demand policy
+ */
+void cpufreq_init()
+{
+	struct mbox_msg msg;
+	unsigned int id[2] = {CLOCK_ARM, 0};
+
+	mbox_msg_begin(&msg);
+	int min = mbox_msg_add(&msg, MBOX_TAG_GETMINCLKRATE, id, 2, 2);
+	int max = mbox_msg_add(&msg, MBOX_TAG_GETMAXCLKRATE, id, 2, 2);
+	if (mbox_msg_send(&msg))
+	{
+		if (mbox_msg_value(&msg, min))
+			min_rate = MBOX_VIEW(&msg, min, struct mbox_clock)->rate;
+		if (mbox_msg_value(&msg, max))
+			max_rate = MBOX_VIEW(&msg, max, struct mbox_clock)->rate;
+	}
+	mbox_msg_end(&msg);
+
+	// Firmware without the limit tags: stay at the current rate
+	unsigned int now = board_clock_rate(CLOCK_ARM);
+	if (!max_rate)
+		max_rate = now;
+	if (!min_rate || min_rate > max_rate)
+		min_rate = max_rate;
+	target_rate = now;
+
+	cpufreq_set_rate(cpufreq_wanted_rate());
+}
+
+/**
+ * Switch policy. rate (Hz) is only used by CPUFREQ_PINNED and is clamped
+ * to the firmware limits. Returns 0 for an unknown policy.
+ */
+int cpufreq_set_policy(unsigned int new_policy, unsigned int rate)
+{
+	if (new_policy > CPUFREQ_PINNED)
+		return 0;
+
+	if (new_policy == CPUFREQ_PINNED)
+	{
+		if (rate < min_rate)
+			rate = min_rate;
+		if (rate > max_rate)
+			rate = max_rate;
+		pinned_rate = rate;
+	}
+	policy = new_policy;
+	cpufreq_set_rate(cpufreq_wanted_rate());
+	return 1;
+}
+
+unsigned int cpufreq_policy()
+{
+	return policy;
+}
+
+char *cpufreq_policy_name(unsigned int p)
+{
+	return p <= CPUFREQ_PINNED ? policy_names[p] : "unknown";
+}
+
+unsigned int cpufreq_min_rate()
+{
+	return min_rate;
+}
+
+unsigned int cpufreq_max_rate()
+{
+	return max_rate;
+}
+
+/**
+ * ARM clock in Hz as reported by the firmware
+ */
+unsigned int cpufreq_current_rate()
+{
+	return board_clock_rate(CLOCK_ARM);
+}
+
+/**
+ * Number of clock changes made so far
+ */
+unsigned int cpufreq_transitions()
+{
+	return transitions;
+}
+
+/**
+ * Mark the start of heavy work (rendering, decoding, benchmarks). Under
+ * the on-demand policy the core runs at the maximum rate until the
+ * matching cpufreq_busy_end(). Calls may nest.
+ */
+void cpufreq_busy_begin()
+{
+	busy++;
+	cpufreq_set_rate(cpufreq_wanted_rate());
+}
+
+void cpufreq_busy_end()
+{
+	if (busy > 0)
+		busy--;
+	cpufreq_set_rate(cpufreq_wanted_rate());
+}
@@ -0,0 +1,19 @@
+// -----------------------------------cpufreq.h -------------------------------------
+
+/* ARM clock policies */
+#define CPUFREQ_ONDEMAND 0	  // maximum while busy, minimum when idle
+#define CPUFREQ_PERFORMANCE 1 // always the maximum
+#define CPUFREQ_POWERSAVE 2	  // always the minimum
+#define CPUFREQ_PINNED 3	  // a fixed rate chosen by the user
+
+/* Function prototypes */
+void cpufreq_init();
+int cpufreq_set_policy(unsigned int policy, unsigned int rate);
+unsigned int cpufreq_policy();
+char *cpufreq_policy_name(unsigned int policy);
+unsigned int cpufreq_min_rate();
+unsigned int cpufreq_max_rate();
+unsigned int cpufreq_current_rate();
+unsigned int cpufreq_transitions();
+void cpufreq_busy_begin();
+void cpufreq_busy_end();
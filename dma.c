@@ -0,0 +1,145 @@
+// -----------------------------------dma.c -------------------------------------
+#include "dma.h"
+#include "mmu.h"
+
+extern char __dma_nc_pool[], __dma_nc_end[];
+extern char __dma_cached_start[], __dma_cached_end[];
+
+#define POOL_MAX_GRANULES ((2 << 20) / DMA_GRANULE)
+#define BITS_PER_WORD 64
+
+/* Buffer pool tracked by a bitmap of DMA_GRANULE-sized granules */
+struct dma_pool
+{
+	unsigned long base;
+	unsigned long granules;
+	unsigned long used[POOL_MAX_GRANULES / BITS_PER_WORD];
+};
+
+static struct dma_pool pools[2];
+
+static void pool_init(struct dma_pool *pool, char *start, char *end)
+{
+	pool->base = (unsigned long)start;
+	pool->granules = (end - start) / DMA_GRANULE;
+}
+
+static int granule_used(struct dma_pool *pool, unsigned long g)
+{
+	return (pool->used[g / BITS_PER_WORD] >> (g % BITS_PER_WORD)) & 1;
+}
+
+static void mark_granules(struct dma_pool *pool, unsigned long first, unsigned long count, int used)
+{
+	for (unsigned long g = first; g < first + count; g++)
+	{
+		if (used)
+			pool->used[g / BITS_PER_WORD] |= 1UL << (g % BITS_PER_WORD);
+		else
+			pool->used[g / BITS_PER_WORD] &= ~(1UL << (g % BITS_PER_WORD));
+	}
+}
+
+/* First granule at or after g whose address is a multiple of align */
+static unsigned long next_aligned(struct dma_pool *pool, unsigned long g, unsigned long align)
+{
+	unsigned long addr = pool->base + g * DMA_GRANULE;
+	addr = (addr + align - 1) & ~(align - 1);
+	return (addr - pool->base) / DMA_GRANULE;
+}
+
+static struct dma_pool *pool_of(void *ptr)
+{
+	for (int i = 0; i < 2; i++)
+	{
+		if (pools[i].granules && (unsigned long)ptr >= pools[i].base &&
+			(unsigned long)ptr < pools[i].base + pools[i].granules * DMA_GRANULE)
+			return &pools[i];
+	}
+	return 0;
+}
+
+/**
+ * Allocate a buffer aligned to align bytes (a power of two) from the
+ * DMA_COHERENT or DMA_CACHED pool. Returns 0 when the pool is exhausted.
+ */
+void *dma_alloc_aligned(unsigned long size, unsigned long align, int type)
+{
+	if (!pools[0].granules)
+	{
+		pool_init(&pools[DMA_COHERENT], __dma_nc_pool, __dma_nc_end);
+		pool_init(&pools[DMA_CACHED], __dma_cached_start, __dma_cached_end);
+	}
+	if (size == 0 || (type != DMA_COHERENT && type != DMA_CACHED))
+		return 0;
+
+	struct dma_pool *pool = &pools[type];
+	unsigned long count = (size + DMA_GRANULE - 1) / DMA_GRANULE;
+	unsigned long g;
+
+	if (align < DMA_GRANULE)
+		align = DMA_GRANULE;
+	g = next_aligned(pool, 0, align);
+
+	// First fit: find a free run of count granules
+	while (g + count <= pool->granules)
+	{
+		unsigned long n = 0;
+		while (n < count && !granule_used(pool, g + n))
+			n++;
+
+		if (n == count)
+		{
+			mark_granules(pool, g, count, 1);
+			return (void *)(pool->base + g * DMA_GRANULE);
+		}
+		// skip past the used granule, rounded up to the alignment
+		g = next_aligned(pool, g + n + 1, align);
+	}
+	return 0;
+}
+
+/**
+ * Allocate a cache-line aligned buffer
+ */
+void *dma_alloc(unsigned long size, int type)
+{
+	return dma_alloc_aligned(size, DMA_GRANULE, type);
+}
+
+/**
+ * Return a buffer to its pool (size as passed to dma_alloc)
+ */
+void dma_free(void *ptr, unsigned long size)
+{
+	struct dma_pool *pool = pool_of(ptr);
+	if (!pool)
+		return;
+
+	unsigned long first = ((unsigned long)ptr - pool->base) / DMA_GRANULE;
+	mark_granules(pool, first, (size + DMA_GRANULE - 1) / DMA_GRANULE, 0);
+}
+
+/**
+ * Hand a cacheable buffer to the device: write the CPU's data to memory
+ */
+void dma_sync_for_device(void *ptr, unsigned long size)
+{
+	dcache_clean_range(ptr, size);
+}
+
+/**
+ * Take a cacheable buffer back from the device: drop stale cached lines
+ */
+void dma_sync_for_cpu(void *ptr, unsigned long size)
+{
+	dcache_invalidate_range(ptr, size);
+}
+
+/**
+ * VideoCore bus address of a buffer (uncached alias of ARM RAM)
+ */
+unsigned int dma_bus_addr(void *ptr)
+{
+	return ((unsigned int)(unsigned long)ptr & 0x3FFFFFFF) | 0xC0000000;
+}
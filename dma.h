@@ -0,0 +1,16 @@
+// -----------------------------------dma.h -------------------------------------
+
+/* Buffer types for dma_alloc() */
+#define DMA_COHERENT 0 // non-cacheable pool, no cache maintenance needed
+#define DMA_CACHED 1   // cacheable pool, see dma_sync_for_device/cpu
+
+/* Allocation granule: one cache line, so cached buffers never share a line */
+#define DMA_GRANULE 64
+
+/* Function prototypes */
+void *dma_alloc(unsigned long size, int type);
+void *dma_alloc_aligned(unsigned long size, unsigned long align, int type);
+void dma_free(void *ptr, unsigned long size);
+void dma_sync_for_device(void *ptr, unsigned long size);
+void dma_sync_for_cpu(void *ptr, unsigned long size);
+unsigned int dma_bus_addr(void *ptr);
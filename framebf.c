@@ -1,294 +1,757 @@
 // ----------------------------------- framebf.c -------------------------------------
+#include "framebf.h"
 #include "mbox.h"
 #include "uart1.h"
 #include "font.h"
-
-#define SCR_WIDTH 1024
-#define SCR_HEIGHT 768
-
-//Use RGBA32 (32 bits for each pixel)
-#define COLOR_DEPTH 32
+#include "string.h"
+#include "timer.h"
+#include "blit.h"
+#include "cma.h"
 
 //Pixel Order: BGR in memory order (little endian --> RGB in byte order)
 #define PIXEL_ORDER 0
 
-//Screen info
-unsigned int width, height, pitch;
+/* The one frame buffer, as last reported by the firmware */
+static struct fb_state fbs;
 
-/* Frame buffer address
-* (declare as pointer of unsigned char to access each byte) */
-unsigned char *fb;
+/*
+ * Regions of the back buffer changed since the last present, and the ones
+ * changed the frame before (the hidden page has not seen those yet).
+ * Inclusive coordinates.
+ */
+struct fb_rect
+{
+	int x1, y1, x2, y2;
+};
 
+static struct fb_rect dirty[FB_DIRTY_MAX];
+static int ndirty;
+static struct fb_rect shown[FB_DIRTY_MAX];
+static int nshown;
 
-void physical_framebf_init(int w, int h)
+/**
+ * Fill the 0 (keep current) fields of a requested mode
+ */
+static void fb_mode_resolve(const struct fb_mode *mode, struct fb_mode *out)
+{
+	out->width = mode->width ? mode->width : fbs.width;
+	out->height = mode->height ? mode->height : fbs.height;
+	out->virt_width = mode->virt_width ? mode->virt_width : fbs.virt_width;
+	out->virt_height = mode->virt_height ? mode->virt_height : fbs.virt_height;
+	out->depth = mode->depth ? mode->depth : (fbs.depth ? fbs.depth : COLOR_DEPTH);
+	out->pages = mode->pages ? mode->pages : (fbs.pages ? fbs.pages : 1);
+
+	// Double buffering stacks two screens in the virtual buffer
+	if (out->pages >= 2)
+	{
+		out->pages = 2;
+		out->virt_width = out->width;
+		out->virt_height = 2 * out->height;
+	}
+
+	// The virtual buffer always holds at least the visible area
+	if (out->virt_width < out->width)
+		out->virt_width = out->width;
+	if (out->virt_height < out->height)
+		out->virt_height = out->height;
+}
+
+/*
+ * Draw into a cacheable copy of one page taken from the CMA region, so
+ * overdraw and read-modify-write stay in the cache; fb_present() copies
+ * the changed parts out. Without the memory, draw straight into the page
+ * that is not on screen.
+ */
+static void fb_shadow_alloc()
 {
-	mbox[0] = 35 * 4; // Length of message in bytes
-	mbox[1] = MBOX_REQUEST;
-
-	mbox[2] = MBOX_TAG_SETPHYWH; //Set physical width-height
-	mbox[3] = 8;				 // Value size in bytes
-	mbox[4] = 0;				 // REQUEST CODE = 0
-	mbox[5] = w;				 // Value(width)
-	mbox[6] = h;				 // Value(height)
-
-	mbox[7] = MBOX_TAG_SETVIRTWH; //Set virtual width-height
-	mbox[8] = 8;
-	mbox[9] = 0;
-	mbox[10] = 0;
-	mbox[11] = 0;
-
-	mbox[12] = MBOX_TAG_SETVIRTOFF; //Set virtual offset
-	mbox[13] = 8;
-	mbox[14] = 0;
-	mbox[15] = 0; // x offset
-	mbox[16] = 0; // y offset
-
-	mbox[17] = MBOX_TAG_SETDEPTH; //Set color depth
-	mbox[18] = 4;
-	mbox[19] = 0;
-	mbox[20] = COLOR_DEPTH; //Bits per pixel
-
-	mbox[21] = MBOX_TAG_SETPXLORDR; //Set pixel order
-	mbox[22] = 4;
-	mbox[23] = 0;
-	mbox[24] = PIXEL_ORDER;
-
-	mbox[25] = MBOX_TAG_GETFB; //Get frame buffer
-	mbox[26] = 8;
-	mbox[27] = 0;
-	mbox[28] = 16; //alignment in 16 bytes
-	mbox[29] = 0;  //will return Frame Buffer size in bytes
-
-	mbox[30] = MBOX_TAG_GETPITCH; //Get pitch
-	mbox[31] = 4;
-	mbox[32] = 0;
-	mbox[33] = 0; //Will get pitch value here
-
-	mbox[34] = MBOX_TAG_LAST;
+	unsigned long bytes = (unsigned long)fbs.height * fbs.pitch;
 
-	// Call Mailbox
-	if (mbox_call(ADDR(mbox), MBOX_CH_PROP) //mailbox call is successful ?
-		&& mbox[20] == COLOR_DEPTH			//got correct color depth ?
-		&& mbox[24] == PIXEL_ORDER			//got correct pixel order ?
-		&& mbox[28] != 0					//got a valid address for frame buffer ?
-	)
+	if (fbs.shadow && fbs.shadow_size != bytes)
 	{
+		cma_free(fbs.draw);
+		fbs.shadow = 0;
+	}
+	if (!fbs.shadow && (fbs.draw = cma_alloc(bytes, CMA_PAGE)))
+	{
+		fbs.shadow = 1;
+		fbs.shadow_size = bytes;
+	}
+	if (!fbs.shadow)
+		fbs.draw = fbs.base + (fbs.pages == 2 ? (fbs.front ^ 1) * fbs.height * fbs.pitch : 0);
+
+	// Start from a black screen on every page
+	blit_fill((unsigned int *)fbs.draw, bytes / 4, 0);
+	nshown = 0;
+	ndirty = 0;
+	fb_dirty(0, 0, fbs.width - 1, fbs.height - 1);
+	if (fbs.pages == 2)
+		shown[nshown++] = dirty[0];
+}
 
-		/* Convert GPU address to ARM address (clear higher address bits)
-	 * Frame Buffer is located in RAM memory, which VideoCore MMU
-	 * maps it to bus address space starting at 0xC0000000.
-	 * Software accessing RAM directly use physical addresses
-	 * (based at 0x00000000)
-	 */
-		mbox[28] &= 0x3FFFFFFF;
+static int rect_area(struct fb_rect r)
+{
+	return (r.x2 - r.x1 + 1) * (r.y2 - r.y1 + 1);
+}
 
-		// Access frame buffer as 1 byte per each address
-		fb = (unsigned char *)((unsigned long)mbox[28]);
-		uart_puts("Got allocated Frame Buffer at RAM physical address: ");
-		uart_hex(mbox[28]);
-		uart_puts("\n");
+static struct fb_rect rect_union(struct fb_rect a, struct fb_rect b)
+{
+	struct fb_rect r;
+	r.x1 = a.x1 < b.x1 ? a.x1 : b.x1;
+	r.y1 = a.y1 < b.y1 ? a.y1 : b.y1;
+	r.x2 = a.x2 > b.x2 ? a.x2 : b.x2;
+	r.y2 = a.y2 > b.y2 ? a.y2 : b.y2;
+	return r;
+}
+
+/* Overlapping or adjacent */
+static int rect_touch(struct fb_rect a, struct fb_rect b)
+{
+	return a.x1 <= b.x2 + 1 && b.x1 <= a.x2 + 1 && a.y1 <= b.y2 + 1 && b.y1 <= a.y2 + 1;
+}
+
+/*
+ * Add r to a list, coalescing it with every rectangle it touches. A full
+ * list merges r with the entry whose bounding box grows least.
+ */
+static void rect_add(struct fb_rect *list, int *n, struct fb_rect r)
+{
+	for (;;)
+	{
+		int merge = -1;
+		for (int i = 0; i < *n && merge < 0; i++)
+			if (rect_touch(list[i], r))
+				merge = i;
 
-		uart_puts("Frame Buffer Size (bytes): ");
-		uart_dec(mbox[29]);
-		uart_puts("\n");
+		if (merge < 0 && *n < FB_DIRTY_MAX)
+		{
+			list[(*n)++] = r;
+			return;
+		}
+		if (merge < 0)
+		{
+			int best_growth = 0;
+			for (int i = 0; i < *n; i++)
+			{
+				int growth = rect_area(rect_union(list[i], r)) - rect_area(list[i]);
+				if (merge < 0 || growth < best_growth)
+				{
+					merge = i;
+					best_growth = growth;
+				}
+			}
+		}
 
-		width = mbox[5];  // Actual physical width
-		height = mbox[6]; // Actual physical height
-		pitch = mbox[33]; // Number of bytes per line
+		// Take the entry out and retry with the merged box
+		r = rect_union(list[merge], r);
+		list[merge] = list[--*n];
 	}
-	else
+}
+
+/**
+ * Mark (x1, y1)-(x2, y2), corners included, as changed in the back buffer.
+ * Primitives do this themselves; code writing to fb_state.draw directly
+ * must call it.
+ */
+void fb_dirty(int x1, int y1, int x2, int y2)
+{
+	struct fb_rect r = {x1 > 0 ? x1 : 0, y1 > 0 ? y1 : 0,
+						x2 < (int)fbs.width ? x2 : (int)fbs.width - 1,
+						y2 < (int)fbs.height ? y2 : (int)fbs.height - 1};
+
+	if (r.x1 > r.x2 || r.y1 > r.y2)
+		return;
+
+	// Quick exit for the common case of drawing inside the last region
+	if (ndirty)
 	{
-		uart_puts("Unable to get a frame buffer with provided setting\n");
+		struct fb_rect *last = &dirty[ndirty - 1];
+		if (r.x1 >= last->x1 && r.x2 <= last->x2 && r.y1 >= last->y1 && r.y2 <= last->y2)
+			return;
+	}
+	rect_add(dirty, &ndirty, r);
+}
+
+/*
+ * Copy the listed regions of the back buffer into a framebuffer page
+ */
+static unsigned long fb_copy_rects(unsigned char *page, struct fb_rect *list, int n)
+{
+	unsigned long bytes = 0;
+	for (int i = 0; i < n; i++)
+	{
+		struct fb_rect r = list[i];
+		unsigned long offs = r.y1 * fbs.pitch + r.x1 * 4;
+		unsigned long w = r.x2 - r.x1 + 1, h = r.y2 - r.y1 + 1;
+
+		// Full-width regions are one contiguous run
+		if (w * 4 == fbs.pitch)
+			blit_copy((unsigned int *)(page + offs), (const unsigned int *)(fbs.draw + offs), w * h);
+		else
+			blit_copy_2d(page + offs, fbs.pitch, fbs.draw + offs, fbs.pitch, w, h);
+		bytes += w * h * 4;
 	}
+	return bytes;
 }
 
 /**
-* Set virtual screen resolution
-*/
-void virtual_framebf_init(int w, int h)
+ * Change the display mode in one mailbox round trip and update the frame
+ * buffer state from what the firmware actually granted.
+ *
+ * A mode equal to the current one costs nothing. A new visible size that
+ * still fits the current virtual size only sends the physical size, which
+ * lets the firmware keep the allocation. Anything else sets the full mode.
+ * Either way the buffer address is read back, so a moved buffer is seen.
+ *
+ * Returns 0 (and keeps the old state) if the firmware refused the mode.
+ */
+int fb_set_mode(const struct fb_mode *mode)
 {
-	mbox[0] = 35 * 4; // Length of message in bytes
-	mbox[1] = MBOX_REQUEST;
-
-	mbox[2] = MBOX_TAG_SETPHYWH; //Set physical width-height
-	mbox[3] = 8;				 // Value size in bytes
-	mbox[4] = 0;				 // REQUEST CODE = 0
-	mbox[5] = 0;				 // Value(width)
-	mbox[6] = 0;				 // Value(height)
-
-	mbox[7] = MBOX_TAG_SETVIRTWH; //Set virtual width-height
-	mbox[8] = 8;
-	mbox[9] = 0;
-	mbox[10] = w;
-	mbox[11] = h;
-
-	mbox[12] = MBOX_TAG_SETVIRTOFF; //Set virtual offset
-	mbox[13] = 8;
-	mbox[14] = 0;
-	mbox[15] = 0; // x offset
-	mbox[16] = 0; // y offset
-
-	mbox[17] = MBOX_TAG_SETDEPTH; //Set color depth
-	mbox[18] = 4;
-	mbox[19] = 0;
-	mbox[20] = COLOR_DEPTH; //Bits per pixel
-
-	mbox[21] = MBOX_TAG_SETPXLORDR; //Set pixel order
-	mbox[22] = 4;
-	mbox[23] = 0;
-	mbox[24] = PIXEL_ORDER;
-
-	mbox[25] = MBOX_TAG_GETFB; //Get frame buffer
-	mbox[26] = 8;
-	mbox[27] = 0;
-	mbox[28] = 16; //alignment in 16 bytes
-	mbox[29] = 0;  //will return Frame Buffer size in bytes
-
-	mbox[30] = MBOX_TAG_GETPITCH; //Get pitch
-	mbox[31] = 4;
-	mbox[32] = 0;
-	mbox[33] = 0; //Will get pitch value here
-
-	mbox[34] = MBOX_TAG_LAST;
+	struct fb_mode want;
+	fb_mode_resolve(mode, &want);
+
+	if (!want.width || !want.height)
+		return 0;
+
+	uint64_t start = timer_counter();
+	int allocated = (fbs.base != 0);
+
+	if (allocated && want.width == fbs.width && want.height == fbs.height &&
+		want.virt_width == fbs.virt_width && want.virt_height == fbs.virt_height && want.depth == fbs.depth &&
+		want.pages == fbs.pages)
+	{
+		fbs.switch_us = 0;
+		fbs.reused = 1;
+		return 1;
+	}
+
+	int resize_only = allocated && want.depth == fbs.depth &&
+					  want.virt_width == fbs.virt_width && want.virt_height == fbs.virt_height &&
+					  want.width <= fbs.virt_width && want.height <= fbs.virt_height;
+
+	struct mbox_msg msg;
+	unsigned int phys_wh[2] = {want.width, want.height};
+	unsigned int virt_wh[2] = {want.virt_width, want.virt_height};
+	unsigned int offset[2] = {0, 0};
+	unsigned int order = PIXEL_ORDER;
+	unsigned int align = 16; //alignment in 16 bytes
+	int virt = -1, bpp = -1, pxl = -1;
+
+	mbox_msg_begin(&msg);
+	int phys = mbox_msg_add(&msg, MBOX_TAG_SETPHYWH, phys_wh, 2, 2); //Set physical width-height
+	if (!resize_only)
+	{
+		virt = mbox_msg_add(&msg, MBOX_TAG_SETVIRTWH, virt_wh, 2, 2);		//Set virtual width-height
+		mbox_msg_add(&msg, MBOX_TAG_SETVIRTOFF, offset, 2, 2);				//Set virtual offset
+		bpp = mbox_msg_add(&msg, MBOX_TAG_SETDEPTH, &want.depth, 1, 1);	//Set color depth
+		pxl = mbox_msg_add(&msg, MBOX_TAG_SETPXLORDR, &order, 1, 1);		//Set pixel order
+	}
+	int getfb = mbox_msg_add(&msg, MBOX_TAG_GETFB, &align, 1, 2);	 //Get frame buffer (address, size)
+	int getpitch = mbox_msg_add(&msg, MBOX_TAG_GETPITCH, 0, 0, 1); //Get pitch
 
 	// Call Mailbox
-	if (mbox_call(ADDR(mbox), MBOX_CH_PROP) //mailbox call is successful ?
-		&& mbox[20] == COLOR_DEPTH			//got correct color depth ?
-		&& mbox[24] == PIXEL_ORDER			//got correct pixel order ?
-		&& mbox[28] != 0					//got a valid address for frame buffer ?
-	)
+	int ok = mbox_msg_send(&msg);
+	volatile struct mbox_size *size = MBOX_VIEW(&msg, phys, struct mbox_size);
+	volatile struct mbox_size *vsize = MBOX_VIEW(&msg, virt, struct mbox_size);
+	volatile unsigned int *got_depth = mbox_msg_value(&msg, bpp);
+	volatile unsigned int *got_order = mbox_msg_value(&msg, pxl);
+	volatile struct mbox_range *buffer = MBOX_VIEW(&msg, getfb, struct mbox_range);
+	volatile unsigned int *got_pitch = mbox_msg_value(&msg, getpitch);
+
+	ok = ok && size && got_pitch && size->width && size->height //got the screen geometry ?
+		 && buffer && buffer->base != 0;						 //got a valid address for frame buffer ?
+	if (ok && !resize_only)
 	{
+		ok = vsize && vsize->width >= size->width && vsize->height >= size->height //got a usable virtual size ?
+			 && got_depth && *got_depth == want.depth							   //got correct color depth ?
+			 && got_order && *got_order == PIXEL_ORDER;							   //got correct pixel order ?
+	}
+	if (ok)
+	{
+		unsigned int depth = resize_only ? fbs.depth : *got_depth;
+		unsigned int virt_w = resize_only ? fbs.virt_width : vsize->width;
+		ok = (*got_pitch >= virt_w * depth / 8); //pitch covers a full line ?
+	}
+	if (!ok)
+	{
+		uart_puts("Unable to get a frame buffer with provided setting\n");
+		mbox_msg_end(&msg);
+		return 0;
+	}
 
-		/* Convert GPU address to ARM address (clear higher address bits)
+	unsigned char *old_base = fbs.base;
+	fbs.width = size->width;   // Actual physical width
+	fbs.height = size->height; // Actual physical height
+	fbs.pitch = *got_pitch;	   // Number of bytes per line
+
+	/* Convert GPU address to ARM address (clear higher address bits)
 	 * Frame Buffer is located in RAM memory, which VideoCore MMU
 	 * maps it to bus address space starting at 0xC0000000.
 	 * Software accessing RAM directly use physical addresses
 	 * (based at 0x00000000)
 	 */
-		mbox[28] &= 0x3FFFFFFF;
+	fbs.base = (unsigned char *)((unsigned long)(buffer->base & 0x3FFFFFFF));
+	fbs.size = buffer->size;
+	if (!resize_only)
+	{
+		fbs.virt_width = vsize->width;
+		fbs.virt_height = vsize->height;
+		fbs.depth = *got_depth;
+		fbs.order = *got_order;
+		fbs.xoffset = fbs.yoffset = 0;
+		fbs.front = 0;
+	}
+	mbox_msg_end(&msg);
+
+	fbs.pages = (want.pages == 2 && fbs.virt_height >= 2 * fbs.height) ? 2 : 1;
+	fb_shadow_alloc();
+
+	fbs.reused = (fbs.base == old_base);
+	fbs.switch_us = timer_ticks_to_us(timer_counter() - start);
+
+	uart_puts("\nFrame Buffer ");
+	uart_dec(fbs.width);
+	uart_puts("x");
+	uart_dec(fbs.height);
+	uart_puts(" (virtual ");
+	uart_dec(fbs.virt_width);
+	uart_puts("x");
+	uart_dec(fbs.virt_height);
+	uart_puts(fbs.pages == 2 ? ", double buffered) at " : ") at ");
+	uart_hex((unsigned int)(unsigned long)fbs.base);
+	uart_puts(", ");
+	uart_dec(fbs.size);
+	uart_puts(" bytes, ");
+	uart_puts(fbs.reused ? "same allocation, " : "new allocation, ");
+	uart_puts(fbs.shadow ? "cached back buffer, " : "");
+	uart_dec(fbs.switch_us);
+	uart_puts(" us\n");
+	return 1;
+}
 
-		// Access frame buffer as 1 byte per each address
-		fb = (unsigned char *)((unsigned long)mbox[28]);
-		uart_puts("Got allocated Frame Buffer at RAM physical address: ");
-		uart_hex(mbox[28]);
-		uart_puts("\n");
+/**
+ * Current frame buffer state (base is 0 until a mode has been set)
+ */
+const struct fb_state *fb_info()
+{
+	return &fbs;
+}
 
-		uart_puts("Frame Buffer Size (bytes): ");
-		uart_dec(mbox[29]);
-		uart_puts("\n");
+/**
+ * Show what was drawn since the last call.
+ *
+ * With the cached back buffer only the dirty regions are copied out: into
+ * the hidden page together with the regions changed the frame before (the
+ * hidden page missed those), then the visible window moves onto it
+ * (MBOX_TAG_SETVIRTOFF). With a single page they are copied in place.
+ * Without the back buffer the pages are simply flipped.
+ *
+ * Returns 0 if the firmware refused the flip.
+ */
+int fb_present()
+{
+	unsigned int back = fbs.front ^ 1;
+	unsigned char *target = fbs.pages == 2 ? fbs.base + back * fbs.height * fbs.pitch
+										   : fbs.base + fbs.yoffset * fbs.pitch + fbs.xoffset * 4;
 
-		width = mbox[5];  // Actual physical width
-		height = mbox[6]; // Actual physical height
-		pitch = mbox[33]; // Number of bytes per line
+	fbs.present_bytes = 0;
+	if (fbs.shadow)
+	{
+		if (fbs.pages == 2)
+		{
+			// Regions changed in both frames are copied once
+			for (int i = 0; i < ndirty; i++)
+				rect_add(shown, &nshown, dirty[i]);
+			fbs.present_bytes = fb_copy_rects(target, shown, nshown);
+		}
+		else
+		{
+			fbs.present_bytes = fb_copy_rects(target, dirty, ndirty);
+		}
 	}
-	else
+
+	if (fbs.pages == 2)
 	{
-		uart_puts("Unable to get a frame buffer with provided setting\n");
+		if (!fb_pan(0, back * fbs.height))
+			return 0;
+
+		fbs.front = back;
+		if (!fbs.shadow)
+			fbs.draw = fbs.base + (back ^ 1) * fbs.height * fbs.pitch;
 	}
+
+	// This frame's changes are still missing from the new hidden page
+	for (int i = 0; i < ndirty; i++)
+		shown[i] = dirty[i];
+	nshown = ndirty;
+	ndirty = 0;
+	return 1;
 }
 
 /**
-* Set screen to W x H 
+ * Move the visible window to (x, y) inside the virtual buffer with one
+ * mailbox call (MBOX_TAG_SETVIRTOFF); no pixel is touched.
+ *
+ * Returns 0 if the window would leave the virtual buffer or the firmware
+ * refused the offset.
+ */
+int fb_pan(unsigned int x, unsigned int y)
+{
+	struct mbox_msg msg;
+	unsigned int offset[2] = {x, y};
+
+	if (x + fbs.width > fbs.virt_width || y + fbs.height > fbs.virt_height)
+		return 0;
+
+	mbox_msg_begin(&msg);
+	int off = mbox_msg_add(&msg, MBOX_TAG_SETVIRTOFF, offset, 2, 2);
+	int ok = mbox_msg_send(&msg);
+	volatile struct mbox_size *got = MBOX_VIEW(&msg, off, struct mbox_size);
+	ok = ok && got && got->width == x && got->height == y;
+	mbox_msg_end(&msg);
+	if (!ok)
+		return 0;
+
+	fbs.xoffset = x;
+	fbs.yoffset = y;
+	return 1;
+}
+
+/**
+ * Copy img to the top left corner of the virtual buffer, clipped to it,
+ * bypassing the back buffer. Used to upload content once and then show
+ * different parts of it with fb_pan().
+ */
+void fb_load_virtual(const struct fb_image *img)
+{
+	unsigned long w = img->width < fbs.virt_width ? img->width : fbs.virt_width;
+	unsigned long h = img->height < fbs.virt_height ? img->height : fbs.virt_height;
+
+	if (!fbs.base)
+		return;
+	blit_copy_2d(fbs.base, fbs.pitch, (const unsigned char *)img->pixels, img->stride * 4, w, h);
+}
+
+/**
+ * Show the drawn page by copying all of it over the visible one, the way
+ * a single buffered display without dirty tracking works (see flipbench)
+ */
+void fb_present_copy()
+{
+	unsigned char *front = fbs.base + (fbs.pages == 2 ? fbs.front * fbs.height * fbs.pitch : 0);
+	if (front == fbs.draw)
+		return;
+	blit_copy((unsigned int *)front, (const unsigned int *)fbs.draw, (unsigned long)fbs.height * fbs.pitch / 4);
+
+	// The hidden page now lags by a whole frame
+	ndirty = 0;
+	nshown = 0;
+	fb_dirty(0, 0, fbs.width - 1, fbs.height - 1);
+	shown[nshown++] = dirty[--ndirty];
+}
+
+/**
+* Set physical screen resolution
+*/
+void physical_framebf_init(int w, int h)
+{
+	struct fb_mode mode = {w, h, 0, 0, 0, 0};
+	fb_set_mode(&mode);
+}
+
+/**
+* Set virtual screen resolution
+*/
+void virtual_framebf_init(int w, int h)
+{
+	struct fb_mode mode = {0, 0, w, h, 0, 0};
+	fb_set_mode(&mode);
+}
+
+/**
+* Set screen to W x H, double buffered
 */
 void framebf_init(int w, int h)
 {
-	mbox[0] = 35 * 4; // Length of message in bytes
-	mbox[1] = MBOX_REQUEST;
-
-	mbox[2] = MBOX_TAG_SETPHYWH; //Set physical width-height
-	mbox[3] = 8;				 // Value size in bytes
-	mbox[4] = 0;				 // REQUEST CODE = 0
-	mbox[5] = w;				 // Value(width)
-	mbox[6] = h;				 // Value(height)
-
-	mbox[7] = MBOX_TAG_SETVIRTWH; //Set virtual width-height
-	mbox[8] = 8;
-	mbox[9] = 0;
-	mbox[10] = w;
-	mbox[11] = h;
-
-	mbox[12] = MBOX_TAG_SETVIRTOFF; //Set virtual offset
-	mbox[13] = 8;
-	mbox[14] = 0;
-	mbox[15] = 0; // x offset
-	mbox[16] = 0; // y offset
-
-	mbox[17] = MBOX_TAG_SETDEPTH; //Set color depth
-	mbox[18] = 4;
-	mbox[19] = 0;
-	mbox[20] = COLOR_DEPTH; //Bits per pixel
-
-	mbox[21] = MBOX_TAG_SETPXLORDR; //Set pixel order
-	mbox[22] = 4;
-	mbox[23] = 0;
-	mbox[24] = PIXEL_ORDER;
-
-	mbox[25] = MBOX_TAG_GETFB; //Get frame buffer
-	mbox[26] = 8;
-	mbox[27] = 0;
-	mbox[28] = 16; //alignment in 16 bytes
-	mbox[29] = 0;  //will return Frame Buffer size in bytes
-
-	mbox[30] = MBOX_TAG_GETPITCH; //Get pitch
-	mbox[31] = 4;
-	mbox[32] = 0;
-	mbox[33] = 0; //Will get pitch value here
-
-	mbox[34] = MBOX_TAG_LAST;
+	struct fb_mode mode = {w, h, w, h, 0, 2};
+	fb_set_mode(&mode);
+}
 
-	// Call Mailbox
-	if (mbox_call(ADDR(mbox), MBOX_CH_PROP) //mailbox call is successful ?
-		&& mbox[20] == COLOR_DEPTH			//got correct color depth ?
-		&& mbox[24] == PIXEL_ORDER			//got correct pixel order ?
-		&& mbox[28] != 0					//got a valid address for frame buffer ?
-	)
-	{
+static inline void put_pixel(int x, int y, unsigned char attr)
+{
+	int offs = (y * fbs.pitch) + (x * 4);
+	*((unsigned int *)(fbs.draw + offs)) = vgapal[attr & 0x0f];
+}
 
-		/* Convert GPU address to ARM address (clear higher address bits)
-	 * Frame Buffer is located in RAM memory, which VideoCore MMU
-	 * maps it to bus address space starting at 0xC0000000.
-	 * Software accessing RAM directly use physical addresses
-	 * (based at 0x00000000)
-	 */
-		mbox[28] &= 0x3FFFFFFF;
+void drawPixel(int x, int y, unsigned char attr)
+{
+	put_pixel(x, y, attr);
+	fb_dirty(x, y, x, y);
+}
 
-		// Access frame buffer as 1 byte per each address
-		fb = (unsigned char *)((unsigned long)mbox[28]);
-		uart_puts("\nFrame Buffer allocated at: ");
-		uart_hex(mbox[28]);
-		uart_puts("\nFrame Buffer Size: ");
-		uart_dec(mbox[29]);
-		uart_puts(" bytes\n");
+/* ------------------------------ span fills ------------------------------ */
 
-		width = mbox[5];  // Actual physical width
-		height = mbox[6]; // Actual physical height
-		pitch = mbox[33]; // Number of bytes per line
-	}
-	else
+/**
+ * Pixel value of a palette entry (low 4 bits of attr)
+ */
+unsigned int fb_palette(unsigned int attr)
+{
+	return vgapal[attr & 0x0f];
+}
+
+/**
+ * Fill len pixels of row y from x, clipped to the screen
+ */
+void fill_span(int x, int y, int len, unsigned int color)
+{
+	int end = x + len;
+
+	if (y < 0 || y >= (int)fbs.height)
+		return;
+	if (x < 0)
+		x = 0;
+	if (end > (int)fbs.width)
+		end = fbs.width;
+	if (x >= end)
+		return;
+
+	fb_dirty(x, y, end - 1, y);
+	blit_fill((unsigned int *)(fbs.draw + y * fbs.pitch) + x, end - x, color);
+}
+
+/**
+ * Fill the rectangle (x1, y1)-(x2, y2), corners included, clipped to the
+ * screen. Rows that cover whole lines are filled in one run.
+ */
+void fill_rect(int x1, int y1, int x2, int y2, unsigned int color)
+{
+	if (x1 < 0)
+		x1 = 0;
+	if (y1 < 0)
+		y1 = 0;
+	if (x2 >= (int)fbs.width)
+		x2 = fbs.width - 1;
+	if (y2 >= (int)fbs.height)
+		y2 = fbs.height - 1;
+	if (x1 > x2 || y1 > y2)
+		return;
+
+	fb_dirty(x1, y1, x2, y2);
+	unsigned int *row = (unsigned int *)(fbs.draw + y1 * fbs.pitch) + x1;
+	unsigned long w = x2 - x1 + 1;
+
+	if (w * 4 == fbs.pitch)
 	{
-		uart_puts("Unable to get a frame buffer with provided setting\n");
+		blit_fill(row, w * (y2 - y1 + 1), color);
+		return;
 	}
+	for (int y = y1; y <= y2; y++, row += fbs.pitch / 4)
+		blit_fill(row, w, color);
 }
 
-void drawPixel(int x, int y, unsigned char attr)
+/**
+ * One pixel wide rectangle border, clipped to the screen
+ */
+void outline_rect(int x1, int y1, int x2, int y2, unsigned int color)
 {
-	int offs = (y * pitch) + (x * 4);
-	*((unsigned int *)(fb + offs)) = vgapal[attr & 0x0f];
+	if (x1 > x2 || y1 > y2)
+		return;
+
+	fb_dirty(x1, y1, x2, y2);
+	fill_span(x1, y1, x2 - x1 + 1, color);
+	fill_span(x1, y2, x2 - x1 + 1, color);
+
+	// Left and right edges, one pixel per row
+	int top = y1 + 1 > 0 ? y1 + 1 : 0;
+	int bottom = y2 - 1 < (int)fbs.height - 1 ? y2 - 1 : (int)fbs.height - 1;
+	for (int y = top; y <= bottom; y++)
+	{
+		unsigned int *row = (unsigned int *)(fbs.draw + y * fbs.pitch);
+		if (x1 >= 0 && x1 < (int)fbs.width)
+			row[x1] = color;
+		if (x2 >= 0 && x2 < (int)fbs.width)
+			row[x2] = color;
+	}
 }
 
 void drawRect(int x1, int y1, int x2, int y2, unsigned int attr, int fill)
 {
+	unsigned int color = fb_palette(attr);
+
+	if (fill)
+		fill_rect(x1, y1, x2, y2, color);
+	else
+		outline_rect(x1, y1, x2, y2, color);
+}
+
+/**
+ * Original per-pixel version, kept for fillbench
+ */
+void drawRect_pixelwise(int x1, int y1, int x2, int y2, unsigned int attr, int fill)
+{
+	fb_dirty(x1, y1, x2, y2);
 	for (int y = y1; y <= y2; y++)
 		for (int x = x1; x <= x2; x++)
 		{
 			if ((x == x1 || x == x2) || (y == y1 || y == y2))
-				drawPixel(x, y, attr);
+				put_pixel(x, y, attr);
 			else if (fill)
-				drawPixel(x, y, attr);
+				put_pixel(x, y, attr);
 		}
 }
 
+/*
+ * Vertical run of pixels at x between y1 and y2 (either order), clipped
+ */
+static void fill_column(int x, int y1, int y2, unsigned int color)
+{
+	int top = y1 < y2 ? y1 : y2, bottom = y1 < y2 ? y2 : y1;
+
+	if (x < 0 || x >= (int)fbs.width)
+		return;
+	top = top > 0 ? top : 0;
+	bottom = bottom < (int)fbs.height - 1 ? bottom : (int)fbs.height - 1;
+	if (top > bottom)
+		return;
+
+	fb_dirty(x, top, x, bottom);
+	unsigned int *p = (unsigned int *)(fbs.draw + top * fbs.pitch) + x;
+	for (int n = bottom - top; n >= 0; n--, p += fbs.pitch / 4)
+		*p = color;
+}
+
+/* Cohen-Sutherland region codes */
+#define CLIP_LEFT 1
+#define CLIP_RIGHT 2
+#define CLIP_TOP 4
+#define CLIP_BOTTOM 8
+
+static int clip_code(int x, int y)
+{
+	int code = 0;
+	if (x < 0)
+		code |= CLIP_LEFT;
+	else if (x >= (int)fbs.width)
+		code |= CLIP_RIGHT;
+	if (y < 0)
+		code |= CLIP_TOP;
+	else if (y >= (int)fbs.height)
+		code |= CLIP_BOTTOM;
+	return code;
+}
+
+/*
+ * Cut the segment down to the part on screen (Cohen-Sutherland). Returns 0
+ * if none of it is.
+ */
+static int clip_line(int *x1, int *y1, int *x2, int *y2)
+{
+	int code1 = clip_code(*x1, *y1), code2 = clip_code(*x2, *y2);
+
+	while (code1 | code2)
+	{
+		if (code1 & code2)
+			return 0; // both ends beyond the same edge
+
+		// Move the end that is outside onto the edge it crosses
+		int code = code1 ? code1 : code2;
+		long dx = *x2 - *x1, dy = *y2 - *y1;
+		int x, y;
+		if (code & CLIP_TOP)
+		{
+			y = 0;
+			x = *x1 + dx * (y - *y1) / dy;
+		}
+		else if (code & CLIP_BOTTOM)
+		{
+			y = fbs.height - 1;
+			x = *x1 + dx * (y - *y1) / dy;
+		}
+		else if (code & CLIP_LEFT)
+		{
+			x = 0;
+			y = *y1 + dy * (x - *x1) / dx;
+		}
+		else
+		{
+			x = fbs.width - 1;
+			y = *y1 + dy * (x - *x1) / dx;
+		}
+
+		if (code == code1)
+		{
+			*x1 = x;
+			*y1 = y;
+			code1 = clip_code(x, y);
+		}
+		else
+		{
+			*x2 = x;
+			*y2 = y;
+			code2 = clip_code(x, y);
+		}
+	}
+	return 1;
+}
+
+/**
+ * Line from (x1, y1) to (x2, y2), both ends included, in any direction.
+ * Clipped to the screen first; horizontal lines are span fills, vertical
+ * ones a column walk, and the rest integer Bresenham stepping a pixel
+ * pointer.
+ */
 void drawLine(int x1, int y1, int x2, int y2, unsigned char attr)
+{
+	unsigned int color = fb_palette(attr);
+
+	if (!clip_line(&x1, &y1, &x2, &y2))
+		return;
+
+	if (y1 == y2)
+	{
+		fill_span(x1 < x2 ? x1 : x2, y1, (x1 < x2 ? x2 - x1 : x1 - x2) + 1, color);
+		return;
+	}
+
+	if (x1 == x2)
+	{
+		fill_column(x1, y1, y2, color);
+		return;
+	}
+
+	int stride = fbs.pitch / 4;
+
+	int dx = x2 > x1 ? x2 - x1 : x1 - x2;
+	int dy = y2 > y1 ? y1 - y2 : y2 - y1; // negative
+	int step_x = x2 > x1 ? 1 : -1;
+	int step_y = y2 > y1 ? stride : -stride;
+	int err = dx + dy;
+	unsigned int *p = (unsigned int *)(fbs.draw + y1 * fbs.pitch) + x1;
+
+	fb_dirty(x1 < x2 ? x1 : x2, y1 < y2 ? y1 : y2, x1 < x2 ? x2 : x1, y1 < y2 ? y2 : y1);
+
+	// One pixel per step along the major axis
+	for (int n = dx > -dy ? dx : -dy; n >= 0; n--)
+	{
+		*p = color;
+		int e2 = 2 * err;
+		if (e2 >= dy)
+		{
+			err += dy;
+			p += step_x;
+		}
+		if (e2 <= dx)
+		{
+			err += dx;
+			p += step_y;
+		}
+	}
+}
+
+/**
+ * Original version (first octant only, end point excluded), kept for
+ * linebench
+ */
+void drawLine_pixelwise(int x1, int y1, int x2, int y2, unsigned char attr)
 {
 	int dx, dy, p, x, y;
 
@@ -302,25 +765,115 @@ void drawLine(int x1, int y1, int x2, int y2, unsigned char attr)
 	{
 		if (p >= 0)
 		{
-			drawPixel(x, y, attr);
+			put_pixel(x, y, attr);
 			y++;
 			p = p + 2 * dy - 2 * dx;
 		}
 		else
 		{
-			drawPixel(x, y, attr);
+			put_pixel(x, y, attr);
 			p = p + 2 * dy;
 		}
 		x++;
 	}
+	fb_dirty(x1, y1, x2 - 1, y);
 }
 
-void drawCircle(int x0, int y0, int radius, unsigned char attr, int fill)
+/* What round_shape() draws */
+#define SHAPE_EDGE 1
+#define SHAPE_INSIDE 2
+
+/*
+ * Half width of row dy of an rx x ry ellipse quadrant: the largest x whose
+ * pixel center lies inside the ellipse grown by half a pixel (the midpoint
+ * test), i.e. (2x)^2 (2ry+1)^2 + (2dy)^2 (2rx+1)^2 <= (2rx+1)^2 (2ry+1)^2.
+ * x only shrinks as dy grows, so callers walk the rows outwards and keep x.
+ */
+static int ellipse_extent(int x, int dy, long a2, long b2)
+{
+	while (x >= 0 && 4L * x * x * b2 + 4L * dy * dy * a2 > a2 * b2)
+		x--;
+	return x;
+}
+
+/*
+ * Spans of the row y of a round shape whose half width is cur on this row
+ * and whose edge reaches in to lo (cur >= lo), around the straight part
+ * cx1..cx2. The outer row is all edge. Every pixel is written once.
+ */
+static void shape_row(int y, int cx1, int cx2, int cur, int lo, int outer, unsigned int edge, unsigned int inside,
+					  int mode)
+{
+	if (mode == SHAPE_INSIDE)
+	{
+		fill_span(cx1 - cur, y, cx2 - cx1 + 2 * cur + 1, inside);
+		return;
+	}
+
+	// Left and right edge pieces meet: one span
+	if (outer || cx1 - lo + 1 >= cx2 + lo)
+	{
+		fill_span(cx1 - cur, y, cx2 - cx1 + 2 * cur + 1, edge);
+		return;
+	}
+	fill_span(cx1 - cur, y, cur - lo + 1, edge);
+	fill_span(cx2 + lo, y, cur - lo + 1, edge);
+	if (mode & SHAPE_INSIDE)
+		fill_span(cx1 - lo + 1, y, cx2 - cx1 + 2 * lo - 1, inside);
+}
+
+/*
+ * Rectangle cx1..cx2 x cy1..cy2 grown by rounded (elliptic) corners of
+ * radii rx and ry: a single point grows into an ellipse, a rectangle into
+ * a rounded rectangle. The quadrant is walked one row at a time from the
+ * middle outwards and each scanline becomes at most three span fills.
+ */
+static void round_shape(int cx1, int cy1, int cx2, int cy2, int rx, int ry,
+						unsigned int edge, unsigned int inside, int mode)
+{
+	long a2 = (2L * rx + 1) * (2L * rx + 1), b2 = (2L * ry + 1) * (2L * ry + 1);
+	int cur = rx;
+
+	if (rx < 0 || ry < 0 || cx1 > cx2 || cy1 > cy2)
+		return;
+
+	for (int dy = 0; dy <= ry; dy++)
+	{
+		// The edge of this row reaches in to where the next row out ends
+		int next = dy < ry ? ellipse_extent(cur, dy + 1, a2, b2) : -1;
+		int lo = next + 1 < cur ? next + 1 : cur;
+
+		shape_row(cy1 - dy, cx1, cx2, cur, lo, next < 0, edge, inside, mode);
+		if (cy2 + dy != cy1 - dy)
+			shape_row(cy2 + dy, cx1, cx2, cur, lo, next < 0, edge, inside, mode);
+		cur = next;
+	}
+
+	// Straight sides between the rounded ends
+	if (cy2 - cy1 < 2)
+		return;
+	if (mode == SHAPE_INSIDE)
+	{
+		fill_rect(cx1 - rx, cy1 + 1, cx2 + rx, cy2 - 1, inside);
+		return;
+	}
+	fill_column(cx1 - rx, cy1 + 1, cy2 - 1, edge);
+	if (cx2 + rx != cx1 - rx)
+		fill_column(cx2 + rx, cy1 + 1, cy2 - 1, edge);
+	if (mode & SHAPE_INSIDE)
+		fill_rect(cx1 - rx + 1, cy1 + 1, cx2 + rx - 1, cy2 - 1, inside);
+}
+/**
+ * Original version (overlapping line fills, then the outline over them),
+ * kept for shapebench
+ */
+void drawCircle_lines(int x0, int y0, int radius, unsigned char attr, int fill)
 {
 	int x = radius;
 	int y = 0;
 	int err = 0;
 
+	fb_dirty(x0 - radius, y0 - radius, x0 + radius, y0 + radius);
 	while (x >= y)
 	{
 		if (fill)
@@ -330,14 +883,14 @@ void drawCircle(int x0, int y0, int radius, unsigned char attr, int fill)
 			drawLine(x0 - x, y0 - y, x0 + x, y0 - y, (attr & 0xf0) >> 4);
 			drawLine(x0 - y, y0 - x, x0 + y, y0 - x, (attr & 0xf0) >> 4);
 		}
-		drawPixel(x0 - y, y0 + x, attr);
-		drawPixel(x0 + y, y0 + x, attr);
-		drawPixel(x0 - x, y0 + y, attr);
-		drawPixel(x0 + x, y0 + y, attr);
-		drawPixel(x0 - x, y0 - y, attr);
-		drawPixel(x0 + x, y0 - y, attr);
-		drawPixel(x0 - y, y0 - x, attr);
-		drawPixel(x0 + y, y0 - x, attr);
+		put_pixel(x0 - y, y0 + x, attr);
+		put_pixel(x0 + y, y0 + x, attr);
+		put_pixel(x0 - x, y0 + y, attr);
+		put_pixel(x0 + x, y0 + y, attr);
+		put_pixel(x0 - x, y0 - y, attr);
+		put_pixel(x0 + x, y0 - y, attr);
+		put_pixel(x0 - y, y0 - x, attr);
+		put_pixel(x0 + y, y0 - x, attr);
 
 		if (err <= 0)
 		{
@@ -353,34 +906,333 @@ void drawCircle(int x0, int y0, int radius, unsigned char attr, int fill)
 	}
 }
 
+/**
+ * Ellipse of radii rx, ry centred on (xc, yc), clipped to the screen
+ */
+void fill_ellipse(int xc, int yc, int rx, int ry, unsigned int color)
+{
+	round_shape(xc, yc, xc, yc, rx, ry, 0, color, SHAPE_INSIDE);
+}
+
+void outline_ellipse(int xc, int yc, int rx, int ry, unsigned int color)
+{
+	round_shape(xc, yc, xc, yc, rx, ry, color, 0, SHAPE_EDGE);
+}
+
+/*
+ * Corner radius limited to half the shorter side
+ */
+static int round_rect_radius(int x1, int y1, int x2, int y2, int r)
+{
+	if (r > (x2 - x1) / 2)
+		r = (x2 - x1) / 2;
+	if (r > (y2 - y1) / 2)
+		r = (y2 - y1) / 2;
+	return r > 0 ? r : 0;
+}
+
+/**
+ * Rectangle (x1, y1)-(x2, y2), corners included, rounded with radius r
+ */
+void fill_round_rect(int x1, int y1, int x2, int y2, int r, unsigned int color)
+{
+	r = round_rect_radius(x1, y1, x2, y2, r);
+	round_shape(x1 + r, y1 + r, x2 - r, y2 - r, r, r, 0, color, SHAPE_INSIDE);
+}
+
+void outline_round_rect(int x1, int y1, int x2, int y2, int r, unsigned int color)
+{
+	r = round_rect_radius(x1, y1, x2, y2, r);
+	round_shape(x1 + r, y1 + r, x2 - r, y2 - r, r, r, color, 0, SHAPE_EDGE);
+}
+
+/*
+ * Palette attribute form shared by the draw* shapes: the outline in the
+ * low nibble, as for text, and with fill set the inside in the high one
+ */
+static void draw_round_shape(int cx1, int cy1, int cx2, int cy2, int rx, int ry, unsigned char attr, int fill)
+{
+	round_shape(cx1, cy1, cx2, cy2, rx, ry, fb_palette(attr & 0x0f), fb_palette((attr & 0xf0) >> 4),
+				fill ? SHAPE_EDGE | SHAPE_INSIDE : SHAPE_EDGE);
+}
+
+void drawCircle(int x0, int y0, int radius, unsigned char attr, int fill)
+{
+	draw_round_shape(x0, y0, x0, y0, radius, radius, attr, fill);
+}
+
+void drawEllipse(int xc, int yc, int rx, int ry, unsigned char attr, int fill)
+{
+	draw_round_shape(xc, yc, xc, yc, rx, ry, attr, fill);
+}
+
+void drawRoundRect(int x1, int y1, int x2, int y2, int r, unsigned char attr, int fill)
+{
+	r = round_rect_radius(x1, y1, x2, y2, r);
+	draw_round_shape(x1 + r, y1 + r, x2 - r, y2 - r, r, r, attr, fill);
+}
+
+
 void clearScreen(int color)
 {
-	drawRect(0, 0, 1024, 768, color, 1);
+	fill_rect(0, 0, fbs.width - 1, fbs.height - 1, fb_palette(color));
 }
 
+/**
+ * Copy the w x h rectangle at (sx, sy) of img to (dx, dy) on screen. The
+ * rectangle is clipped to the image and to the screen once, then copied
+ * row by row with the NEON kernel.
+ */
+void fb_blit(const struct fb_image *img, int sx, int sy, int w, int h, int dx, int dy)
+{
+	// Clip to the image...
+	if (sx < 0)
+	{
+		dx -= sx;
+		w += sx;
+		sx = 0;
+	}
+	if (sy < 0)
+	{
+		dy -= sy;
+		h += sy;
+		sy = 0;
+	}
+	if (w > (int)img->width - sx)
+		w = img->width - sx;
+	if (h > (int)img->height - sy)
+		h = img->height - sy;
+
+	// ...then to the screen
+	if (dx < 0)
+	{
+		sx -= dx;
+		w += dx;
+		dx = 0;
+	}
+	if (dy < 0)
+	{
+		sy -= dy;
+		h += dy;
+		dy = 0;
+	}
+	if (w > (int)fbs.width - dx)
+		w = fbs.width - dx;
+	if (h > (int)fbs.height - dy)
+		h = fbs.height - dy;
+	if (w <= 0 || h <= 0)
+		return;
+
+	fb_dirty(dx, dy, dx + w - 1, dy + h - 1);
+	blit_copy_2d(fbs.draw + dy * fbs.pitch + dx * 4, fbs.pitch,
+				 (const unsigned char *)(img->pixels + (unsigned long)sy * img->stride + sx), img->stride * 4, w, h);
+}
+
+/**
+ * Draw a 1-bpp bitmap with its top left corner at (dx, dy): fg for set
+ * bits, bg for clear ones unless transparent. Clipped to the screen once,
+ * then every row is expanded with the NEON mono kernel.
+ */
+void fb_mono(const struct fb_bitmap *bm, int dx, int dy, unsigned int fg, unsigned int bg, int transparent)
+{
+	int sx = 0, sy = 0, w = bm->width, h = bm->height;
+
+	if (dx < 0)
+	{
+		sx = -dx;
+		w += dx;
+		dx = 0;
+	}
+	if (dy < 0)
+	{
+		sy = -dy;
+		h += dy;
+		dy = 0;
+	}
+	if (w > (int)fbs.width - dx)
+		w = fbs.width - dx;
+	if (h > (int)fbs.height - dy)
+		h = fbs.height - dy;
+	if (w <= 0 || h <= 0)
+		return;
+
+	fb_dirty(dx, dy, dx + w - 1, dy + h - 1);
+	unsigned char *row = fbs.draw + dy * fbs.pitch + dx * 4;
+	const unsigned char *bits = bm->bits + sy * bm->stride;
+	for (; h; h--, row += fbs.pitch, bits += bm->stride)
+		blit_mono((unsigned int *)row, bits, sx, w, fg, bg, transparent);
+}
+
+/**
+ * Move what is on screen by (dx, dy) pixels with an overlapping block move,
+ * into the back buffer. The strips uncovered at the edges keep stale pixels
+ * for the caller to redraw.
+ */
+void fb_scroll(int dx, int dy)
+{
+	int w = fbs.width - (dx < 0 ? -dx : dx);
+	int h = fbs.height - (dy < 0 ? -dy : dy);
+	int sx = dx < 0 ? -dx : 0, tx = dx > 0 ? dx : 0;
+	int sy = dy < 0 ? -dy : 0, ty = dy > 0 ? dy : 0;
+
+	if (w <= 0 || h <= 0)
+		return;
+
+	// Drawing straight into the hidden page: it holds the frame before last
+	unsigned char *src = fbs.draw;
+	if (!fbs.shadow && fbs.pages == 2)
+		src = fbs.base + fbs.front * fbs.height * fbs.pitch;
+
+	fb_dirty(tx, ty, tx + w - 1, ty + h - 1);
+
+	// Rows moving down are copied bottom up, so none is overwritten unread
+	for (int i = 0; i < h; i++)
+	{
+		int row = dy > 0 ? h - 1 - i : i;
+		blit_move((unsigned int *)(fbs.draw + (ty + row) * fbs.pitch) + tx,
+				  (const unsigned int *)(src + (sy + row) * fbs.pitch) + sx, w);
+	}
+}
+
+/**
+ * Draw a whole w x h image with its top left corner at (x, y), clipped
+ */
 void drawImage(unsigned int image[], int x, int y, int w, int h)
 {
-	int count = 0;
+	struct fb_image img = {image, w, h, w};
+	fb_blit(&img, 0, 0, w, h, x, y);
+}
+
+/*
+ * Glyph cache: glyphs pre-expanded to 32-bit pixels, one tile per
+ * (character, attribute) pair in use, found through a small hash table.
+ * When all tiles are taken the least recently drawn one is replaced.
+ * Chain links and hash heads hold tile index + 1, so 0 ends a chain.
+ */
+#define GLYPH_HASH_SIZE 128
+
+struct glyph_tile
+{
+	int key;			// glyph << 8 | attr
+	int next;			// next tile in the hash chain
+	unsigned long used; // draw stamp, smallest is least recently drawn
+	unsigned int pixels[FONT_HEIGHT * FONT_WIDTH];
+};
+
+static struct glyph_tile glyphs[GLYPH_CACHE_SIZE];
+static int glyph_hash[GLYPH_HASH_SIZE];
+static int glyphs_used;
+static unsigned long glyph_clock;
+static struct glyph_stats gstats;
+
+static inline int glyph_bucket(int key)
+{
+	return ((key >> 8) ^ (key * 7)) & (GLYPH_HASH_SIZE - 1);
+}
+
+/**
+ * Drop every cached tile
+ */
+void glyph_cache_flush()
+{
+	for (int i = 0; i < GLYPH_HASH_SIZE; i++)
+		glyph_hash[i] = 0;
+	glyphs_used = 0;
+}
+
+/**
+ * Hit, miss and eviction counts since boot, and tiles in use
+ */
+const struct glyph_stats *glyph_cache_stats()
+{
+	gstats.tiles = glyphs_used;
+	return &gstats;
+}
+
+static void glyph_unlink(int slot)
+{
+	int *link = &glyph_hash[glyph_bucket(glyphs[slot].key)];
+	while (*link != slot + 1)
+		link = &glyphs[*link - 1].next;
+	*link = glyphs[slot].next;
+}
+
+static struct glyph_tile *glyph_get(unsigned char ch, unsigned char attr)
+{
+	int glyph = ch < FONT_NUMGLYPHS ? ch : 0;
+	int key = glyph << 8 | attr;
+	int bucket = glyph_bucket(key);
+	struct glyph_tile *t;
 
-	while (y < h)
+	for (int i = glyph_hash[bucket]; i; i = t->next)
 	{
-		while (x < w)
+		t = &glyphs[i - 1];
+		if (t->key == key)
 		{
-			int offs = (y * pitch) + (x * 4); //print array
-			*((unsigned int *)(fb + offs)) = image[count];
-
-			x++;
-			count++;
+			t->used = ++glyph_clock;
+			gstats.hits++;
+			return t;
 		}
-		y++;
-		x = 0;
 	}
+
+	// Take a free tile, or the least recently drawn one
+	int slot = glyphs_used;
+	if (glyphs_used < GLYPH_CACHE_SIZE)
+		glyphs_used++;
+	else
+	{
+		slot = 0;
+		for (int i = 1; i < GLYPH_CACHE_SIZE; i++)
+			if (glyphs[i].used < glyphs[slot].used)
+				slot = i;
+		glyph_unlink(slot);
+		gstats.evictions++;
+	}
+	gstats.misses++;
+
+	// Glyph rows are whole bytes, so the tile is one contiguous run of bits
+	t = &glyphs[slot];
+	blit_mono(t->pixels, (unsigned char *)&font + glyph * FONT_BPG, 0, FONT_HEIGHT * FONT_WIDTH,
+			  vgapal[attr & 0x0f], vgapal[(attr & 0xf0) >> 4], 0);
+
+	t->key = key;
+	t->used = ++glyph_clock;
+	t->next = glyph_hash[bucket];
+	glyph_hash[bucket] = slot + 1;
+	return t;
 }
 
+/**
+ * Draw a character from the glyph cache: one clipped row copy per line
+ */
 void drawChar(unsigned char ch, int x, int y, unsigned char attr)
+{
+	struct glyph_tile *t = glyph_get(ch, attr);
+	struct fb_image tile = {t->pixels, FONT_WIDTH, FONT_HEIGHT, FONT_WIDTH};
+
+	fb_blit(&tile, 0, 0, FONT_WIDTH, FONT_HEIGHT, x, y);
+}
+
+/**
+ * Expand a character straight from the font, without the cache. With
+ * transparent set only the foreground pixels are written.
+ */
+void drawChar_mono(unsigned char ch, int x, int y, unsigned char attr, int transparent)
+{
+	struct fb_bitmap glyph = {(unsigned char *)&font + (ch < FONT_NUMGLYPHS ? ch : 0) * FONT_BPG,
+							  FONT_WIDTH, FONT_HEIGHT, FONT_BPL};
+
+	fb_mono(&glyph, x, y, vgapal[attr & 0x0f], vgapal[(attr & 0xf0) >> 4], transparent);
+}
+
+/**
+ * Original bit-by-bit version, kept for glyphbench
+ */
+void drawChar_pixelwise(unsigned char ch, int x, int y, unsigned char attr)
 {
 	unsigned char *glyph = (unsigned char *)&font + (ch < FONT_NUMGLYPHS ? ch : 0) * FONT_BPG;
 
+	fb_dirty(x, y, x + FONT_WIDTH - 1, y + FONT_HEIGHT - 1);
 	for (int i = 0; i < FONT_HEIGHT; i++)
 	{
 		for (int j = 0; j < FONT_WIDTH; j++)
@@ -388,13 +1240,123 @@ void drawChar(unsigned char ch, int x, int y, unsigned char attr)
 			unsigned char mask = 1 << j;
 			unsigned char col = (*glyph & mask) ? attr & 0x0f : (attr & 0xf0) >> 4;
 
-			drawPixel(x + j, y + i, col);
+			put_pixel(x + j, y + i, col);
 		}
 		glyph += FONT_BPL;
 	}
 }
 
+/*
+ * One scanline of a cached glyph, copied as a unit
+ */
+struct glyph_row
+{
+	unsigned int pixels[FONT_WIDTH];
+};
+
+/*
+ * Write scanlines top to bottom - 1 of a run of n characters starting at
+ * line (the framebuffer address of glyph row 0 of the first character)
+ */
+static void text_rows(unsigned char *line, const char *s, int n, unsigned char attr, int top, int bottom)
+{
+	struct glyph_tile *tiles[TEXT_RUN_MAX];
+
+	/* A run has fewer distinct glyphs than the cache has tiles, so looking
+	 * up later characters never evicts the tiles of earlier ones */
+	for (int start = 0; start < n; start += TEXT_RUN_MAX, line += TEXT_RUN_MAX * FONT_WIDTH * 4)
+	{
+		int count = n - start < TEXT_RUN_MAX ? n - start : TEXT_RUN_MAX;
+		for (int i = 0; i < count; i++)
+			tiles[i] = glyph_get(s[start + i], attr);
+
+		unsigned char *row_start = line + top * fbs.pitch;
+		for (int row = top; row < bottom; row++, row_start += fbs.pitch)
+		{
+			struct glyph_row *dst = (struct glyph_row *)row_start;
+			for (int i = 0; i < count; i++)
+				dst[i] = *(struct glyph_row *)&tiles[i]->pixels[row * FONT_WIDTH];
+		}
+	}
+}
+
+/**
+ * Draw len characters on one text line, a scanline at a time: every row of
+ * the framebuffer is written left to right in a single pass over the run,
+ * instead of jumping between FONT_HEIGHT rows for each character. Glyphs
+ * cut by the left or right edge go through drawChar().
+ */
+void drawTextRun(int x, int y, const char *s, int len, unsigned char attr)
+{
+	// Characters entirely on screen
+	int first = x < 0 ? (-x + FONT_WIDTH - 1) / FONT_WIDTH : 0;
+	int last = ((int)fbs.width - x) / FONT_WIDTH; // one past
+	if (last > len)
+		last = len;
+	if (first >= last || y + FONT_HEIGHT <= 0 || y >= (int)fbs.height)
+	{
+		for (int i = 0; i < len; i++)
+			drawChar(s[i], x + i * FONT_WIDTH, y, attr);
+		return;
+	}
+	if (first > 0)
+		drawChar(s[first - 1], x + (first - 1) * FONT_WIDTH, y, attr);
+	if (last < len)
+		drawChar(s[last], x + last * FONT_WIDTH, y, attr);
+
+	int top = y < 0 ? -y : 0;
+	int bottom = y + FONT_HEIGHT > (int)fbs.height ? (int)fbs.height - y : FONT_HEIGHT;
+	fb_dirty(x + first * FONT_WIDTH, y + top, x + last * FONT_WIDTH - 1, y + bottom - 1);
+	text_rows(fbs.draw + y * fbs.pitch + (x + first * FONT_WIDTH) * 4, s + first, last - first, attr, top, bottom);
+}
+
+/**
+ * Draw a run of characters straight into the virtual buffer, at character
+ * cell (col, row) of its whole height, bypassing the back buffer. Used by
+ * the console, which shows its text by panning. Cells outside the virtual
+ * buffer are dropped.
+ */
+void drawTextVirtual(int col, int row, const char *s, int len, unsigned char attr)
+{
+	int cols = fbs.virt_width / FONT_WIDTH;
+
+	if (!fbs.base || col < 0 || row < 0 || (row + 1) * FONT_HEIGHT > (int)fbs.virt_height)
+		return;
+	if (len > cols - col)
+		len = cols - col;
+	if (len > 0)
+		text_rows(fbs.base + row * FONT_HEIGHT * fbs.pitch + col * FONT_WIDTH * 4, s, len, attr, 0, FONT_HEIGHT);
+}
+
 void drawString(int x, int y, char *s, unsigned char attr)
+{
+	while (*s)
+	{
+		if (*s == '\r')
+		{
+			x = 0;
+			s++;
+		}
+		else if (*s == '\n')
+		{
+			x = 0;
+			y += FONT_HEIGHT;
+			s++;
+		}
+		else
+		{
+			int len = strcspn(s, "\r\n");
+			drawTextRun(x, y, s, len, attr);
+			x += len * FONT_WIDTH;
+			s += len;
+		}
+	}
+}
+
+/**
+ * Original glyph by glyph version, kept for glyphbench
+ */
+void drawString_glyphwise(int x, int y, char *s, unsigned char attr)
 {
 	while (*s)
 	{
@@ -431,7 +1393,7 @@ void drawOnScreen()
     {
         // Assuming a character takes up about 10 pixels in width (modify this if different)
         int estimatedStrWidth = strLength * 10;
-        return (SCR_WIDTH - estimatedStrWidth) / 2;
+        return ((int)fbs.width - estimatedStrWidth) / 2;
     }
 
     // Draw title and underline
@@ -449,7 +1411,7 @@ void drawOnScreen()
     drawString(centerPosition(strlen("Programming:               ")) + strlen("Programming") * 10 + 10, START_Y + 3 * LINE_SPACING, "Nguyen Nam Vinh", 0x6);
 
     // Draw Circles
-    drawCircle(SCR_WIDTH / 2, SCR_HEIGHT / 2, CIRCLE_RADIUS_LARGE, 0x09, 0);  // Centered large circle
+    drawCircle(fbs.width / 2, fbs.height / 2, CIRCLE_RADIUS_LARGE, 0x09, 0);  // Centered large circle
 }
 
 
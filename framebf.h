@@ -1,18 +1,120 @@
 // ----------------------------------- framebf.h -------------------------------------
 
+#ifndef FRAMEBF_H
+#define FRAMEBF_H
+
+/* Default screen mode set at boot */
 #define SCR_WIDTH 1024
 #define SCR_HEIGHT 768
 
+/* Character cell of the built-in font (font.h) */
+#define CHAR_WIDTH 8
+#define CHAR_HEIGHT 8
+
+//Use RGBA32 (32 bits for each pixel)
+#define COLOR_DEPTH 32
+
+/* Changed regions tracked per frame before they are merged coarser */
+#define FB_DIRTY_MAX 16
+
+/* Pre-expanded (character, attribute) tiles kept by the glyph cache */
+#define GLYPH_CACHE_SIZE 256
+
+/* Characters the text run renderer fetches from the cache per pass */
+#define TEXT_RUN_MAX 128
+
+/* Requested display mode (0 in a field keeps the current value) */
+struct fb_mode
+{
+	unsigned int width, height;			  // visible (physical) size
+	unsigned int virt_width, virt_height; // virtual size, at least the visible one
+	unsigned int depth;					  // bits per pixel
+	unsigned int pages;					  // 2 = double buffered (virtual size is ignored)
+};
+
+/* Frame buffer as granted by the firmware */
+struct fb_state
+{
+	unsigned char *base; // ARM address, 0 if not allocated
+	unsigned int size;	 // bytes
+	unsigned int width, height;
+	unsigned int virt_width, virt_height;
+	unsigned int xoffset, yoffset; // visible window inside the virtual buffer
+	unsigned int pitch;			   // bytes per line
+	unsigned int depth, order;
+	unsigned int pages;	 // 1, or 2 when double buffered
+	unsigned int front;	 // page on screen
+	unsigned char *draw; // back buffer the drawing routines write to (same pitch)
+	int shadow;			 // draw is a cached buffer outside the frame buffer
+	unsigned long shadow_size;
+	unsigned long present_bytes; // copied out by the last fb_present()
+	unsigned long switch_us;	 // duration of the last mode switch
+	int reused;					 // the last switch kept the existing buffer
+};
+
+/* Source image for fb_blit (32-bit pixels in screen order) */
+struct fb_image
+{
+	const unsigned int *pixels;
+	unsigned int width, height;
+	unsigned int stride; // pixels from one row to the next, at least width
+};
+
+/* 1-bpp source for fb_mono: bit 0 of each byte is the leftmost pixel */
+struct fb_bitmap
+{
+	const unsigned char *bits;
+	unsigned int width, height;
+	unsigned int stride; // bytes from one row to the next
+};
+
+struct glyph_stats
+{
+	unsigned long hits, misses, evictions;
+	unsigned int tiles; // in use
+};
+
+int fb_set_mode(const struct fb_mode *mode);
+const struct fb_state *fb_info();
+int fb_present();
+void fb_dirty(int x1, int y1, int x2, int y2);
+void fb_present_copy();
+int fb_pan(unsigned int x, unsigned int y);
+void fb_load_virtual(const struct fb_image *img);
 void physical_framebf_init(int w, int h);
 void virtual_framebf_init(int w, int h);
 void framebf_init(int w, int h);
-void drawPixel(int x, int y, unsigned int attr);
+void drawPixel(int x, int y, unsigned char attr);
+unsigned int fb_palette(unsigned int attr);
+void fill_span(int x, int y, int len, unsigned int color);
+void fill_rect(int x1, int y1, int x2, int y2, unsigned int color);
+void outline_rect(int x1, int y1, int x2, int y2, unsigned int color);
 void drawRect(int x1, int y1, int x2, int y2, unsigned int attr, int fill);
+void drawRect_pixelwise(int x1, int y1, int x2, int y2, unsigned int attr, int fill);
 void drawLine(int x1, int y1, int x2, int y2, unsigned char attr);
+void drawLine_pixelwise(int x1, int y1, int x2, int y2, unsigned char attr);
+void fill_ellipse(int xc, int yc, int rx, int ry, unsigned int color);
+void outline_ellipse(int xc, int yc, int rx, int ry, unsigned int color);
+void fill_round_rect(int x1, int y1, int x2, int y2, int r, unsigned int color);
+void outline_round_rect(int x1, int y1, int x2, int y2, int r, unsigned int color);
 void drawCircle(int x0, int y0, int radius, unsigned char attr, int fill);
+void drawCircle_lines(int x0, int y0, int radius, unsigned char attr, int fill);
+void drawEllipse(int xc, int yc, int rx, int ry, unsigned char attr, int fill);
+void drawRoundRect(int x1, int y1, int x2, int y2, int r, unsigned char attr, int fill);
 void clearScreen(int color);
+void fb_blit(const struct fb_image *img, int sx, int sy, int w, int h, int dx, int dy);
+void fb_mono(const struct fb_bitmap *bm, int dx, int dy, unsigned int fg, unsigned int bg, int transparent);
+void fb_scroll(int dx, int dy);
 void drawImage(unsigned int image[], int x, int y, int w, int h);
 void drawChar(unsigned char ch, int x, int y, unsigned char attr);
+void drawChar_pixelwise(unsigned char ch, int x, int y, unsigned char attr);
+void drawChar_mono(unsigned char ch, int x, int y, unsigned char attr, int transparent);
+void glyph_cache_flush();
+const struct glyph_stats *glyph_cache_stats();
+void drawTextRun(int x, int y, const char *s, int len, unsigned char attr);
+void drawTextVirtual(int col, int row, const char *s, int len, unsigned char attr);
 void drawString(int x, int y, char *s, unsigned char attr);
+void drawString_glyphwise(int x, int y, char *s, unsigned char attr);
 void drawOnScreen();
 
+#endif
@@ -0,0 +1,140 @@
+// -----------------------------------irq.c -------------------------------------
+#include "irq.h"
+#include "uart1.h"
+#include "smp.h"
+
+extern char vectors[]; // vectors.S
+
+static irq_handler_t basic_handlers[IRQ_BASIC_COUNT];
+static irq_handler_t local_handlers[SMP_MAX_CORES][IRQ_LOCAL_COUNT];
+
+/* Per core: the account the interrupt being handled is charged to (read and
+ * cleared by vectors.S on exit), and whether one is being handled */
+uint64_t *irq_account[SMP_MAX_CORES];
+static volatile int irq_active[SMP_MAX_CORES];
+
+static const char *exception_names[] = {
+	"SYNC (SP0)", "IRQ (SP0)", "FIQ (SP0)", "SERROR (SP0)",
+	"SYNC", "IRQ", "FIQ", "SERROR",
+	"SYNC (EL0)", "IRQ (EL0)", "FIQ (EL0)", "SERROR (EL0)",
+	"SYNC (EL0 32-bit)", "IRQ (EL0 32-bit)", "FIQ (EL0 32-bit)", "SERROR (EL0 32-bit)"};
+
+/**
+ * Install the vector table on the calling core and unmask IRQs.
+ * Each core that takes interrupts must call this once.
+ */
+void irq_init()
+{
+	asm volatile("msr vbar_el1, %0\n isb" ::"r"((unsigned long)vectors)
+				 : "memory");
+	asm volatile("msr daifclr, #2" ::: "memory");
+}
+
+/**
+ * Route one of the basic GPU interrupts (IRQ_BASIC_*) to handler.
+ * GPU interrupts are delivered to core 0.
+ */
+void irq_enable_basic(unsigned int irq, irq_handler_t handler)
+{
+	if (irq >= IRQ_BASIC_COUNT)
+		return;
+	basic_handlers[irq] = handler;
+	asm volatile("dsb sy" ::: "memory");
+	ENABLE_BASIC_IRQS = 1 << irq;
+}
+
+void irq_disable_basic(unsigned int irq)
+{
+	if (irq >= IRQ_BASIC_COUNT)
+		return;
+	DISABLE_BASIC_IRQS = 1 << irq;
+	basic_handlers[irq] = 0;
+}
+
+/**
+ * Register a handler for a per-core source (IRQ_LOCAL_*). The source itself
+ * (e.g. the core timer control register) is enabled by the caller.
+ */
+void irq_enable_local(unsigned int core, unsigned int irq, irq_handler_t handler)
+{
+	if (core >= SMP_MAX_CORES || irq >= IRQ_LOCAL_COUNT || irq == IRQ_LOCAL_GPU)
+		return;
+	local_handlers[core][irq] = handler;
+	asm volatile("dsb sy" ::: "memory");
+}
+
+/**
+ * Return non-zero if IRQs are unmasked on the calling core
+ */
+int irq_enabled()
+{
+	unsigned long daif;
+	asm volatile("mrs %0, daif"
+				 : "=r"(daif));
+	return !(daif & (1 << 7));
+}
+
+/**
+ * Charge the whole interrupt being handled on this core, from vector entry
+ * to eret including the register frame, to *account (counter ticks, added
+ * by vectors.S on the way out). Returns 0 outside interrupt context, where
+ * the caller has to time itself.
+ */
+int irq_charge(uint64_t *account)
+{
+	unsigned int core = smp_core_id();
+	if (!irq_active[core])
+		return 0;
+	irq_account[core] = account;
+	return 1;
+}
+
+/**
+ * Called from vectors.S for every IRQ taken at EL1
+ */
+void irq_handler()
+{
+	unsigned int core = smp_core_id();
+	unsigned int source = CORE_IRQ_SOURCE(core);
+
+	irq_active[core] = 1;
+
+	for (unsigned int irq = 0; irq < IRQ_LOCAL_COUNT; irq++)
+	{
+		if (!(source & (1 << irq)) || irq == IRQ_LOCAL_GPU)
+			continue;
+		if (local_handlers[core][irq])
+			local_handlers[core][irq]();
+	}
+
+	if (source & (1 << IRQ_LOCAL_GPU))
+	{
+		unsigned int pending = IRQ_BASIC_PENDING & ((1 << IRQ_BASIC_COUNT) - 1);
+		for (unsigned int irq = 0; irq < IRQ_BASIC_COUNT; irq++)
+		{
+			if (!(pending & (1 << irq)))
+				continue;
+			if (basic_handlers[irq])
+				basic_handlers[irq]();
+			else
+				DISABLE_BASIC_IRQS = 1 << irq; // nobody handles it, stop it firing
+		}
+	}
+	irq_active[core] = 0;
+}
+
+/**
+ * Called from vectors.S for any other exception: report it and stop
+ */
+void exception_handler(unsigned long type, unsigned long esr, unsigned long elr, unsigned long far)
+{
+	uart_puts("\n\nUnexpected exception: ");
+	uart_puts((char *)exception_names[type & 15]);
+	uart_puts("\nESR: ");
+	uart_hex(esr);
+	uart_puts("  ELR: ");
+	uart_hex(elr); // everything is identity mapped below 4 GB
+	uart_puts("  FAR: ");
+	uart_hex(far);
+	uart_puts("\n");
+}
@@ -0,0 +1,40 @@
+// -----------------------------------irq.h -------------------------------------
+#include "gpio.h"
+#include "./gcclib/stdint.h"
+
+/* Legacy interrupt controller (ARM side of the BCM2837 GPU interrupts) */
+#define IRQ_BASIC_PENDING (*(volatile unsigned int *)(MMIO_BASE + 0x0000B200))
+#define IRQ_PENDING_1 (*(volatile unsigned int *)(MMIO_BASE + 0x0000B204))
+#define IRQ_PENDING_2 (*(volatile unsigned int *)(MMIO_BASE + 0x0000B208))
+#define ENABLE_IRQS_1 (*(volatile unsigned int *)(MMIO_BASE + 0x0000B210))
+#define ENABLE_IRQS_2 (*(volatile unsigned int *)(MMIO_BASE + 0x0000B214))
+#define ENABLE_BASIC_IRQS (*(volatile unsigned int *)(MMIO_BASE + 0x0000B218))
+#define DISABLE_IRQS_1 (*(volatile unsigned int *)(MMIO_BASE + 0x0000B21C))
+#define DISABLE_IRQS_2 (*(volatile unsigned int *)(MMIO_BASE + 0x0000B220))
+#define DISABLE_BASIC_IRQS (*(volatile unsigned int *)(MMIO_BASE + 0x0000B224))
+
+/* Per-core interrupt sources (local peripherals, GPU interrupts go to core 0) */
+#define CORE_TIMER_IRQCNTL(core) (*(volatile unsigned int *)(0x40000040UL + 4 * (core)))
+#define CORE_IRQ_SOURCE(core) (*(volatile unsigned int *)(0x40000060UL + 4 * (core)))
+
+/* Bits in IRQ_BASIC_PENDING / ENABLE_BASIC_IRQS */
+#define IRQ_BASIC_ARM_TIMER 0
+#define IRQ_BASIC_MAILBOX 1
+#define IRQ_BASIC_COUNT 8
+
+/* Bits in CORE_IRQ_SOURCE */
+#define IRQ_LOCAL_CNTPNS 1 // EL1 physical timer
+#define IRQ_LOCAL_GPU 8
+#define IRQ_LOCAL_COUNT 12
+
+typedef void (*irq_handler_t)(void);
+
+/* Function prototypes */
+void irq_init();
+void irq_enable_basic(unsigned int irq, irq_handler_t handler);
+void irq_disable_basic(unsigned int irq);
+void irq_enable_local(unsigned int core, unsigned int irq, irq_handler_t handler);
+int irq_enabled();
+int irq_charge(uint64_t *account);
+void irq_handler();
+void exception_handler(unsigned long type, unsigned long esr, unsigned long elr, unsigned long far);
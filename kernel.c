@@ -6,20 +6,21 @@
 #include "framebf.h"
 #include "image.h"
 #include "video.h"
+#include "timer.h"
+#include "smp.h"
+#include "bench.h"
+#include "mmu.h"
+#include "string.h"
+#include "board.h"
+#include "irq.h"
+#include "cpufreq.h"
+#include "telemetry.h"
+#include "console.h"
 
 #define MAX_CMD_SIZE 100
 #define MAX_HISTORY 10
 #define NULL ((void *)0)
 
-// manual string functions declaration
-int strlen(const char *str);
-char *strcpy(char *dest, const char *src);
-int strcmp(const char *str1, const char *str2);
-int strncmp(const char *str1, const char *str2, int n);
-char *strtok(char *str, const char *delim);
-int strspn(const char *str, const char *set);
-int strcspn(const char *str, const char *set);
-char *strchr(const char *str, int c);
 int convert(char s[]);
 
 
@@ -61,27 +62,66 @@ char *commands[] = {
     "expandscreen",
     "getmacaddress",
     "getuartfreq",
-    "getarmfreq"};
+    "getarmfreq",
+    "membench",
+    "strbench",
+    "mboxbench",
+    "flipbench",
+    "cpufreq",
+    "baud",
+    "telemetry",
+    "fillbench",
+    "blitbench",
+    "glyphbench",
+    "console",
+    "linebench",
+    "shapebench"};
 char *commandsInfo[] = {
     "*Show detail information of each command\nUsage: help [command_name]\n",
     "clear - Clears the screen\n",
     "setcolor - Sets text and/or background color\nUsage: setcolor -t [color] -b [background_color]\n",
     "showinfo - Displays board information\n",
     "printf - Test the printf function\n",
-    "expandscreen - Expand the qemu display screen\n",
+    "expandscreen - Resize the qemu display screen\nUsage: expandscreen [width height]\n",
     "getmacaddress - Display the MAC Adress\n",
     "getuartfreq - Display the Uart Frequency\n",
-    "getarmfreq - Display the ARM Frequency\n}"};
+    "getarmfreq - Display the ARM Frequency\n",
+    "membench - Measure memory bandwidth and latency\nUsage: membench [cores]\n",
+    "strbench - Benchmark the string routines\n",
+    "mboxbench - Measure mailbox round trip latency\nUsage: mboxbench [n]\n",
+    "flipbench - Compare page flipping with copying a frame\nUsage: flipbench [frames]\n",
+    "cpufreq - Show or set the ARM clock policy\nUsage: cpufreq [ondemand|performance|powersave|<MHz>]\n",
+    "baud - Show or change the serial baud rate\nUsage: baud [rate]\n",
+    "telemetry - Show SoC temperature, clocks and throttling\nUsage: telemetry [rows|start [ms]|stop]\n",
+    "fillbench - Compare per-pixel and span rectangle fills\n",
+    "blitbench - Compare scalar, 64-bit and NEON pixel kernels\n",
+    "glyphbench - Compare per-pixel and cached glyph drawing\n",
+    "console - Mirror the terminal on the screen\nUsage: console [on|off]\n",
+    "linebench - Compare the original and Bresenham line drawing\n",
+    "shapebench - Compare line-filled and span-filled shapes\n"};
 char *commandsDetail[] = {
     "help: This command is used to provide a detailed description of available commands. If you want to know more about a specific command, type 'help [command_name]'.\n",
     "clear: Typing 'clear' will remove all the content from your current view, giving you a clean screen to work with.\n",
     "setcolor: Use this command to customize your text and background colors. To change the text color, use the '-t' flag followed by your desired color. For changing the background, use the '-b' flag followed by your choice of color. For instance, 'setcolor -t red -b blue' will give you red text on a blue background.\n",
     "showinfo: Execute this command to view important board details. It will display essential information about the board you're currently working on.\n",
     "printf: This command lets you test the printf function. 'printf' is a fundamental function used in programming to display text or data.\n",
-    "expandscreen: If you feel the qemu display screen is too small or need a larger view, use 'expandscreen'.\n",
+    "expandscreen: 'expandscreen 800 600' shows an 800x600 window of the current frame buffer, which the firmware resizes in place without a new allocation. 'expandscreen' on its own goes back to the full double buffered screen. Prints the size granted and how long the switch took.\n",
     "getmacaddress: To know the MAC address of your board or system, simply type 'getmacaddress'. It will fetch and display the MAC address for you.\n",
     "getuartfreq: By entering 'getuartfreq', you can determine the frequency at which the UART is operating.\n",
-    "getarmfreq: If you're interested in the operational frequency of the ARM processor, use 'getarmfreq'. It will show the default rate at which the ARM CPU is running.\n"};
+    "getarmfreq: If you're interested in the operational frequency of the ARM processor, use 'getarmfreq'. It will show the default rate at which the ARM CPU is running.\n",
+    "membench: Runs STREAM-style copy, scale, add and triad kernels and a random pointer chase over working sets from L1 cache size up to DRAM, and prints MB/s and ns/access tables. 'membench 4' runs the kernels on all four cores at once.\n",
+    "strbench: Times the byte-at-a-time, 64-bit word-at-a-time (SWAR) and NEON versions of strlen and strchr, and the old and table-driven strspn, over strings from 7 to 4096 characters.\n",
+    "mboxbench: Times N mailbox calls (default 200) for the board revision, ARM clock rate and framebuffer pitch tags and prints min/median/p99/max in microseconds, then compares the three tags sent one after another with the same tags batched in a single message.\n",
+    "flipbench: Shows N frames (default 50) three ways: a full redraw presented by flipping between the two framebuffer pages, a frame where only one text line changed (only the dirty regions of the back buffer are copied before the flip), and copying the whole back buffer over the visible page. Prints min/median/p99/max time per frame in microseconds.\n",
+    "cpufreq: Shows the ARM clock policy and the current, minimum and maximum rates. 'ondemand' (the default) runs at the maximum rate while drawing or benchmarking and at the minimum otherwise, 'performance' and 'powersave' stay at the maximum or minimum, and a number pins the clock to that many MHz.\n",
+    "baud: Shows the serial baud rate, or switches to a new one such as 460800 or 921600. The divisor is derived from the core clock and follows it when the clock changes. Reconnect the terminal at the new rate afterwards.\n",
+    "telemetry: Shows the newest samples (default 10) taken by the background sampler: temperature, ARM and core clocks, core voltage and the firmware throttling flags, plus the time the sampler costs per sample. 'telemetry start 500' samples every 500 ms, 'telemetry stop' stops it.\n",
+    "fillbench: Times a full-screen clear and a 256x256 filled and outlined rectangle drawn pixel by pixel and with the span fill routines, and prints the speedup. Drawing goes to the back page, so nothing is shown.\n",
+    "blitbench: Times the scalar, 64-bit and NEON fill and copy kernels over one screen of pixels, into the uncached framebuffer back page and between cached buffers, and prints megapixels per second.\n",
+    "glyphbench: Draws the printable characters with the original bit-by-bit drawChar, with the NEON 1-bpp expansion straight from the font, and through the glyph cache, once emptying the cache before every pass (all misses) and once with every glyph cached. Then draws a full-width line of text glyph by glyph and one scanline at a time. Prints thousands of glyphs per second and the cache counters. Drawing goes to the back buffer, so nothing is shown.\n",
+    "console: With on, shows everything written to the UART on the screen as a text console, including the setcolor colors. New lines scroll by moving the visible window over a virtual frame buffer several screens tall, which is copied back to the top only when its end is reached. off returns to the graphics screen. Without an argument, prints the console counters.\n",
+    "linebench: Draws shallow, steep, horizontal, vertical and screen-crossing (clipped) lines with the original first-octant drawLine and with the clipped all-octant Bresenham version, and prints lines per second. The original cannot draw steep, vertical or clipped lines, shown as -. Drawing goes to the back buffer, so nothing is shown.\n",
+    "shapebench: Times filled and outlined circles drawn with the original routine (overlapping line fills with the outline drawn over them) and with the span-filled shapes, which write every pixel once, and prints the speedup. Also times a filled ellipse and rounded rectangle. Drawing goes to the back buffer, so nothing is shown.\n"};
 
 int num_commands = sizeof(commands) / sizeof(commands[0]);
 char *colors[] = {
@@ -169,90 +209,120 @@ void setcolor(const char *textColor, const char *backgroundColor)
         }
     }
 }
-void showBoardInfo()
+void printBoardRevision(unsigned int revision)
 {
-    unsigned int *responseData = 0;
-    mbox_buffer_setup(ADDR(mbox), 0x00010002, &responseData, 4, 0, NULL); // tag 0x00010002 for boardrivision
-    if (mbox_call(ADDR(mbox), MBOX_CH_PROP))
+    uart_puts("Board Revision: ");
+    uart_dec(revision);
+    uart_puts("\n");
+    uart_puts("Board Revision(in Hexa): ");
+    uart_hex(revision);
+    uart_puts("\n");
+    if (revision == 0x00a02082)
     {
-        uart_puts("Board Revision: ");
-        uart_dec(*responseData);
-        uart_puts("\n");
-        uart_puts("Board Revision(in Hexa): ");
-        uart_hex(*responseData);
-        uart_puts("\n");
-        if (*responseData == 0x00a02082)
-        {
-            uart_puts("Board model: rpi-3B BCM2837 1GiB Sony UK");
-        }
-        else if (*responseData == 0x00900092)
-        {
-            uart_puts("Board model: rpi-Zero BCM2835 512MB Sony UK");
-        }
-        else if (*responseData == 0x00000010)
-        {
-            uart_puts("Board model: rpi-1B+ BCM2835");
-        }
-        else if (*responseData == 0x00a01041)
-        {
-            uart_puts("Board model: rpi-2B BCM2836 1GiB Sony UK");
-        }
-        else if (*responseData == 0x00b03111)
-        {
-            uart_puts("Board model: rpi-4B BCM2711 2GiB Sony UK");
-        }
-        uart_puts("\n\n");
+        uart_puts("Board model: rpi-3B BCM2837 1GiB Sony UK");
     }
-    else
+    else if (revision == 0x00900092)
     {
-        uart_puts("Failed to get board revision.\n");
+        uart_puts("Board model: rpi-Zero BCM2835 512MB Sony UK");
     }
+    else if (revision == 0x00000010)
+    {
+        uart_puts("Board model: rpi-1B+ BCM2835");
+    }
+    else if (revision == 0x00a01041)
+    {
+        uart_puts("Board model: rpi-2B BCM2836 1GiB Sony UK");
+    }
+    else if (revision == 0x00b03111)
+    {
+        uart_puts("Board model: rpi-4B BCM2711 2GiB Sony UK");
+    }
+    uart_puts("\n\n");
 }
-void expandScreen()
+void printMacAddress(const unsigned char *macBytes)
 {
-    unsigned int request_vals[2] = {1024, 768};
-    unsigned int *physize = 0;
-    mbox_buffer_setup(ADDR(mbox), MBOX_TAG_SETPHYWH, &physize, 8, 8, request_vals);
-    mbox_call(ADDR(mbox), MBOX_CH_PROP);
-    uart_puts("\nGot Actual Physical Width: ");
-    uart_dec(physize[0]);
-    uart_puts("\nGot Actual Physical Height: ");
-    uart_dec(physize[1]);
+    uart_puts("MAC Address: 0x");
+    int order1[] = {3, 2, 1, 0}; // Byte order for format
+    for (int i = 0; i < 4; i++)
+    {
+        uart_hex_byte(macBytes[order1[i]]);
+    }
     uart_puts("\n");
+
+    uart_puts("MAC Address: 0x0000"); // first 4 is 0x0000 based on the format
+    int order2[] = {5, 4};            // Byte order for expected format
+    for (int i = 0; i < 2; i++)
+    {
+        uart_hex_byte(macBytes[order2[i]]);
+    }
+    uart_puts("\n");
+
+    // Print colon-separated format
+    uart_puts("MAC Address: ");
+    for (int i = 5; i >= 0; i--)
+    {
+        uart_hex_byte(macBytes[i]);
+        if (i != 0)
+            uart_sendc(':');
+    }
+    uart_puts("\n\n");
 }
-void getMacAddress()
+void showBoardInfo()
 {
-    unsigned int *responseData = 0;
-    mbox_buffer_setup(ADDR(mbox), 0x00010003, &responseData, 8, 0, NULL);
-    if (mbox_call(ADDR(mbox), MBOX_CH_PROP))
+    // Served from the property cache filled at boot, no mailbox round trip
+    const struct board_info *board = board_info();
+    if (!board->valid)
     {
-        unsigned char *macBytes = (unsigned char *)responseData;
-
-        uart_puts("MAC Address: 0x");
-        int order1[] = {3, 2, 1, 0}; // Byte order for format
-        for (int i = 0; i < 4; i++)
-        {
-            uart_hex_byte(macBytes[order1[i]]);
-        }
-        uart_puts("\n");
-
-        uart_puts("MAC Address: 0x0000"); // first 4 is 0x0000 based on the format
-        int order2[] = {5, 4};            // Byte order for expected format
-        for (int i = 0; i < 2; i++)
-        {
-            uart_hex_byte(macBytes[order2[i]]);
-        }
-        uart_puts("\n");
+        uart_puts("Failed to get board revision.\n");
+        return;
+    }
+    printBoardRevision(board->revision);
+    printMacAddress(board->mac);
 
-        // Print colon-separated format
-        uart_puts("MAC Address: ");
-        for (int i = 5; i >= 0; i--)
+    uart_puts("Serial Number: ");
+    uart_hex(board->serial >> 32);
+    uart_hex(board->serial & 0xFFFFFFFF);
+    uart_puts("\nARM Memory: ");
+    uart_dec(board->arm_size >> 20);
+    uart_puts(" MB, VideoCore Memory: ");
+    uart_dec(board->vc_size >> 20);
+    uart_puts(" MB\n\n");
+}
+void expandScreen(char *w, char *h)
+{
+    // A size shows that much of the current virtual buffer, single buffered,
+    // which the firmware resizes in place; no size goes back to the double
+    // buffered SCR_WIDTH x SCR_HEIGHT screen
+    struct fb_mode mode = {SCR_WIDTH, SCR_HEIGHT, 0, 0, 0, 2};
+    if (w || h)
+    {
+        if (!w || !h || !convert(w) || !convert(h))
         {
-            uart_hex_byte(macBytes[i]);
-            if (i != 0)
-                uart_sendc(':');
+            uart_puts("Usage: expandscreen [width height]\n");
+            return;
         }
-        uart_puts("\n\n");
+        mode.width = convert(w);
+        mode.height = convert(h);
+        mode.pages = 1;
+    }
+    if (!fb_set_mode(&mode))
+    {
+        uart_puts("Failed to set the physical size.\n");
+        return;
+    }
+    uart_puts("\nGot Actual Physical Width: ");
+    uart_dec(fb_info()->width);
+    uart_puts("\nGot Actual Physical Height: ");
+    uart_dec(fb_info()->height);
+    uart_puts("\nMode switch took ");
+    uart_dec(fb_info()->switch_us);
+    uart_puts(fb_info()->reused ? " us, buffer kept\n" : " us, buffer reallocated\n");
+}
+void getMacAddress()
+{
+    if (board_info()->valid)
+    {
+        printMacAddress(board_info()->mac);
     }
     else
     {
@@ -262,14 +332,12 @@ void getMacAddress()
 
 void getUartClock()
 {
-    unsigned int request_values[] = {2, 0}; // 2 is the clock id for UART and 0 to clear output buffer
-    unsigned int *responseData = 0;
-    mbox_buffer_setup(ADDR(mbox), 0x00030002, &responseData, 8, 8, request_values); // tag 0x00030002 clock
-    if (mbox_call(ADDR(mbox), MBOX_CH_PROP))
+    unsigned int rate = board_clock_rate(CLOCK_UART);
+    if (rate)
     {
         uart_puts("UART Clock Rate: ");
 
-        uart_dec(responseData[1]);
+        uart_dec(rate);
         uart_puts(" Hz\n\n");
     }
     else
@@ -279,77 +347,329 @@ void getUartClock()
 }
 void getArmFrequency()
 {
-    unsigned int request_values[] = {3, 0}; // 3 is the clock id for ARM and 0 to clear output buffer
-    unsigned int *responseData = 0;
-    mbox_buffer_setup(ADDR(mbox), 0x00030002, &responseData, 8, 8, request_values); // tag 0x00030002 for clock
-
-    if (mbox_call(ADDR(mbox), MBOX_CH_PROP))
+    unsigned int rate = board_clock_rate(CLOCK_ARM);
+    if (rate)
     {
         uart_puts("ARM Frequency: ");
-        uart_dec(responseData[1]);
+        uart_dec(rate);
         uart_puts(" Hz\n\n");
     }
     else
     {
         uart_puts("Failed to get ARM frequency.\n");
     }
-    // //mailbox data buffer: Read ARM frequency
-    // mbox[0] = 8 * 4;        // Message Buffer Size in bytes (8 elements * 4 bytes (32 bit) each)
-    // mbox[1] = MBOX_REQUEST; // Message Request Code (this is a request message)
-    // mbox[2] = 0x00030002;   // TAG Identifier: Get clock rate
-    // mbox[3] = 8;            // Value buffer size in bytes (max of request and response lengths)
-    // mbox[4] = 0;            // REQUEST CODE = 0
-    // mbox[5] = 3;            // clock id: ARM system clock
-    // mbox[6] = 0;            // clear output buffer (response data are mbox[5] & mbox[6])
-    // mbox[7] = MBOX_TAG_LAST;
-
-    // if (mbox_call(ADDR(mbox), MBOX_CH_PROP))
-    // {
-    //     uart_puts("ARM clock rate: ");
-    //     uart_dec(mbox[6]);
-    //     uart_puts(" Hz");
-    //     uart_puts("\n");
-    // }
-    // else
-    // {
-    //     uart_puts("Unable to query!\n");
-    // }
 }
-void drawLargeImageScroll()
+void printMHz(unsigned int rate)
 {
-    uart_puts("Use WASD to scroll. Press Enter to quit scroll mode ");
-    int y = 0;
-    int x = 0;
-    drawImage(image2image2, x, y, 1920, 1080);
-
-    while (1)
+    uart_dec(rate / 1000000);
+    uart_puts(" MHz");
+}
+void cpuFrequency(char *arg)
+{
+    if (arg)
     {
-        char c = uart_getc();
+        int ok;
+        if (strcmp(arg, "ondemand") == 0)
+            ok = cpufreq_set_policy(CPUFREQ_ONDEMAND, 0);
+        else if (strcmp(arg, "performance") == 0)
+            ok = cpufreq_set_policy(CPUFREQ_PERFORMANCE, 0);
+        else if (strcmp(arg, "powersave") == 0)
+            ok = cpufreq_set_policy(CPUFREQ_POWERSAVE, 0);
+        else if (arg[0] >= '0' && arg[0] <= '9')
+        {
+            // Clamp before narrowing: above 4294 MHz the rate would wrap
+            unsigned long rate = (unsigned long)convert(arg) * 1000000;
+            if (rate > cpufreq_max_rate())
+                rate = cpufreq_max_rate();
+            ok = cpufreq_set_policy(CPUFREQ_PINNED, rate);
+        }
+        else
+            ok = 0;
 
-        if (c == 'w')
+        if (!ok)
         {
-            y -= 20;
+            uart_puts("Usage: cpufreq [ondemand|performance|powersave|<MHz>]\n");
+            return;
         }
-        else if (c == 's')
+    }
+
+    uart_puts("Policy: ");
+    uart_puts(cpufreq_policy_name(cpufreq_policy()));
+    uart_puts("\nARM clock: ");
+    printMHz(cpufreq_current_rate());
+    uart_puts(" (min ");
+    printMHz(cpufreq_min_rate());
+    uart_puts(", max ");
+    printMHz(cpufreq_max_rate());
+    uart_puts(")\nClock changes: ");
+    uart_dec(cpufreq_transitions());
+    uart_puts("\n\n");
+}
+void setBaudRate(char *arg)
+{
+    if (arg)
+    {
+        unsigned int baud = convert(arg);
+        if (!uart_baud_supported(baud))
         {
-            y += 20;
+            uart_puts("Unsupported baud rate.\n");
+            return;
         }
-        else if (c == 'd')
+        uart_puts("Switching to ");
+        uart_dec(baud);
+        uart_puts(" baud, reconnect the terminal at the new rate.\n");
+        uart_set_baud(baud);
+    }
+    uart_puts("Baud rate: ");
+    uart_dec(uart_get_baud());
+    uart_puts(" (core clock ");
+    printMHz(board_clock_rate(CLOCK_CORE));
+    uart_puts(")\n\n");
+}
+void framebufferConsole(char *arg)
+{
+    if (arg && strcmp(arg, "on") == 0)
+    {
+        if (!console_enable())
         {
-            x += 20;
+            uart_puts("No frame buffer mode for the console.\n");
+            return;
         }
-        else if (c == 'a')
+    }
+    else if (arg && strcmp(arg, "off") == 0)
+    {
+        console_disable();
+    }
+    else if (arg)
+    {
+        uart_puts("Usage: console [on|off]\n");
+        return;
+    }
+
+    const struct console_stats *stats = console_stats();
+    uart_puts("Console: ");
+    uart_puts(console_active() ? "on" : "off");
+    uart_puts(", ");
+    uart_dec(stats->lines);
+    uart_puts(" lines, ");
+    uart_dec(stats->pans);
+    uart_puts(" scrolled by panning, ");
+    uart_dec(stats->wraps);
+    uart_puts(" wraps (last ");
+    uart_dec(stats->wrap_us);
+    uart_puts(" us)\n\n");
+}
+void showTelemetry(char *arg)
+{
+    int rows = 10;
+    if (arg && strcmp(arg, "stop") == 0)
+    {
+        telemetry_stop();
+        uart_puts("Telemetry stopped.\n\n");
+        return;
+    }
+    if (arg && strcmp(arg, "start") == 0)
+    {
+        char *period = strtok(NULL, " ");
+        if (!telemetry_start(period ? convert(period) : TELEMETRY_PERIOD_MS))
         {
-            x -= 20;
+            uart_puts("Unable to start telemetry.\n\n");
+            return;
         }
-        else if (c == '\n')
+    }
+    else if (arg)
+    {
+        rows = convert(arg);
+    }
+
+    uart_puts("Telemetry: ");
+    if (telemetry_running())
+    {
+        uart_puts("every ");
+        uart_dec(telemetry_period());
+        uart_puts(" ms");
+    }
+    else
+    {
+        uart_puts("stopped");
+    }
+    uart_puts(", ");
+    uart_dec(telemetry_count());
+    uart_puts(" samples, ");
+    uart_dec(telemetry_dropped());
+    uart_puts(" dropped\nOverhead: ");
+    unsigned long ns = telemetry_overhead_ns();
+    uart_dec(ns);
+    uart_puts(" ns per sample");
+    if (telemetry_running())
+    {
+        // share of one core's time, in parts per million
+        uart_puts(" (");
+        uart_dec(ns / telemetry_period());
+        uart_puts(" ppm of one core)");
+    }
+    uart_puts("\n\n   Age(s)  Temp(C)  ARM(MHz) Core(MHz)  Core(mV)  Throttled\n");
+
+    uint64_t now = timer_counter();
+    struct telemetry_sample sample;
+    for (int age = 0; age < rows && telemetry_get(age, &sample); age++)
+    {
+        bench_print_tenths(timer_ticks_to_us(now - sample.time) / 100000, 9);
+        bench_print_tenths(sample.temp / 100, 9);
+        bench_print_col(sample.arm_rate / 1000000, 10);
+        bench_print_col(sample.core_rate / 1000000, 10);
+        bench_print_col(sample.core_volts / 1000, 10);
+        uart_puts("     ");
+        uart_hex_byte(sample.throttled >> 16);
+        uart_hex_byte(sample.throttled);
+        uart_puts("\n");
+    }
+    uart_puts("\n");
+}
+/*
+ * Redraw the window at (x, y) of img as the window at (nx, ny): what is
+ * still visible is moved, only the newly exposed strips come from img
+ */
+void scrollImageView(const struct fb_image *img, int x, int y, int nx, int ny)
+{
+    const struct fb_state *fb = fb_info();
+    int w = fb->width, h = fb->height;
+    int dx = x - nx, dy = y - ny;
+
+    if (dx <= -w || dx >= w || dy <= -h || dy >= h)
+    {
+        fb_blit(img, nx, ny, w, h, 0, 0);
+        return;
+    }
+    fb_scroll(dx, dy);
+    if (dx > 0)
+        fb_blit(img, nx, ny, dx, h, 0, 0);
+    else if (dx < 0)
+        fb_blit(img, nx + w + dx, ny, -dx, h, w + dx, 0);
+    if (dy > 0)
+        fb_blit(img, nx, ny, w, dy, 0, 0);
+    else if (dy < 0)
+        fb_blit(img, nx, ny + h + dy, w, -dy, 0, h + dy);
+}
+void drawLargeImageScroll()
+{
+    struct fb_image img = {image2image2, 1920, 1080, 1920};
+    const struct fb_state *fb = fb_info();
+    unsigned int width = fb->width, height = fb->height;
+    int max_x = (int)img.width > (int)width ? (int)(img.width - width) : 0;
+    int max_y = (int)img.height > (int)height ? (int)(img.height - height) : 0;
+
+    // Upload the whole image once into a virtual buffer as large as it, then
+    // scroll by moving the visible window. Without the GPU memory for it,
+    // move the picture and draw only the strips scrolled into view.
+    cpufreq_busy_begin();
+    clearScreen(0);
+    struct fb_mode pan_mode = {width, height, img.width, img.height, 0, 1};
+    int panning = fb_set_mode(&pan_mode);
+    if (panning && (fb->virt_width < img.width || fb->virt_height < img.height))
+    {
+        // The firmware granted a smaller virtual buffer: it would crop the image
+        struct fb_mode mode = {width, height, 0, 0, 0, 2};
+        fb_set_mode(&mode);
+        panning = 0;
+    }
+    if (panning)
+        fb_load_virtual(&img);
+    else
+    {
+        fb_blit(&img, 0, 0, width, height, 0, 0);
+        fb_present();
+    }
+    cpufreq_busy_end(); // idle at the low clock while waiting for keys
+
+    uart_puts(panning ? "Scrolling by hardware panning.\n" : "Scrolling by incremental redraw.\n");
+    uart_puts("Use WASD to scroll. Press Enter to quit scroll mode ");
+    int y = 0;
+    int x = 0;
+    unsigned int steps = 0;
+    uint64_t total_us = 0, worst_us = 0;
+
+    int done = 0;
+    while (!done)
+    {
+        // Merge the keys queued up meanwhile (a held key) into one step
+        int nx = x, ny = y;
+        char c = uart_getc();
+        while (1)
         {
-            uart_puts("\n");
-            break;
+            if (c == 'w')
+            {
+                ny -= 20;
+            }
+            else if (c == 's')
+            {
+                ny += 20;
+            }
+            else if (c == 'd')
+            {
+                nx += 20;
+            }
+            else if (c == 'a')
+            {
+                nx -= 20;
+            }
+            else if (c == '\n')
+            {
+                uart_puts("\n");
+                done = 1;
+                break;
+            }
+            if (!uart_has_data())
+                break;
+            c = uart_getc();
         }
-        clearScreen(0);
+        nx = nx < 0 ? 0 : (nx > max_x ? max_x : nx);
+        ny = ny < 0 ? 0 : (ny > max_y ? max_y : ny);
+        if (nx == x && ny == y)
+            continue;
+
+        // Keys to new picture on screen
+        cpufreq_busy_begin();
+        uint64_t start = timer_counter();
+        int moved = 1;
+        if (panning)
+            moved = fb_pan(nx, ny);
+        else
+        {
+            scrollImageView(&img, x, y, nx, ny);
+            fb_present();
+        }
+        uint64_t us = timer_ticks_to_us(timer_counter() - start);
+        cpufreq_busy_end();
+        if (!moved)
+            continue; // refused: the window stays where it was
+        total_us += us;
+        worst_us = us > worst_us ? us : worst_us;
+        steps++;
+        x = nx;
+        y = ny;
+    }
+
+    if (steps)
+    {
+        uart_puts("Scrolled ");
+        uart_dec(steps);
+        uart_puts(" times: average ");
+        uart_dec(total_us / steps);
+        uart_puts(" us, worst ");
+        uart_dec(worst_us);
+        uart_puts(" us per step\n");
+    }
 
-        drawImage(image2image2, x, y, 1920, 1080);
+    // Back to the double buffered screen
+    if (panning)
+    {
+        cpufreq_busy_begin();
+        struct fb_mode mode = {width, height, 0, 0, 0, 2};
+        fb_set_mode(&mode);
+        clearScreen(0);
+        fb_present();
+        cpufreq_busy_end();
     }
 }
 void playVideo()
@@ -363,32 +683,15 @@ void playVideo()
         if (i > 7)
             i = 0;
         // printf("%d\n", i);
+        clearScreen(0);
         drawImage(video_frames[i], 0, 0, 453, 421);
+        fb_present();
         wait_ms(60000);
         i++;
         c = uart_get_char();
     }
     uart_puts("\nVideo stopped");
 }
-void wait_ms(unsigned int n)
-{
-    register unsigned long f, t, r;
-
-    // Get the current counter frequency
-    asm volatile("mrs %0, cntfrq_el0"
-                 : "=r"(f));
-    // Read the current counter
-    asm volatile("mrs %0, cntpct_el0"
-                 : "=r"(t));
-    // Calculate expire value for counter
-    t += ((f / 1000) * n) / 1000;
-    do
-    {
-        asm volatile("mrs %0, cntpct_el0"
-                     : "=r"(r));
-    } while (r < t);
-}
-
 void display_prompt()
 {
     uart_puts("GroupOS> ");
@@ -398,15 +701,14 @@ void execute_command(char *cmd)
     if (strcmp(cmd, commands[0]) == 0)
     {
         uart_puts("*Supported commands:\n");
-        uart_puts("help, clear, setcolor, showinfo, printf, expandscreen, getmacaddress, getuartfreq, getarmfreq\n\n");
+        for (int i = 0; i < num_commands; i++)
+        {
+            uart_puts(commands[i]);
+            uart_puts(i < num_commands - 1 ? ", " : "\n\n");
+        }
         uart_puts("*General description:\n");
-        uart_puts(commandsInfo[1]);
-        uart_puts(commandsInfo[2]);
-        uart_puts(commandsInfo[3]);
-        uart_puts(commandsInfo[4]);
-        uart_puts(commandsInfo[5]);
-        uart_puts(commandsInfo[6]);
-        uart_puts(commandsInfo[7]);
+        for (int i = 1; i < num_commands; i++)
+            uart_puts(commandsInfo[i]);
         uart_puts("\n");
         uart_puts(commandsInfo[0]);
         uart_puts("\n");
@@ -447,28 +749,87 @@ void execute_command(char *cmd)
     {
         uart_puts(commandsDetail[8]);
     }
+    else if (strcmp(cmd, "help membench") == 0)
+    {
+        uart_puts(commandsDetail[9]);
+    }
+    else if (strcmp(cmd, "help strbench") == 0)
+    {
+        uart_puts(commandsDetail[10]);
+    }
+    else if (strcmp(cmd, "help mboxbench") == 0)
+    {
+        uart_puts(commandsDetail[11]);
+    }
+    else if (strcmp(cmd, "help flipbench") == 0)
+    {
+        uart_puts(commandsDetail[12]);
+    }
+    else if (strcmp(cmd, "help cpufreq") == 0)
+    {
+        uart_puts(commandsDetail[13]);
+    }
+    else if (strcmp(cmd, "help baud") == 0)
+    {
+        uart_puts(commandsDetail[14]);
+    }
+    else if (strcmp(cmd, "help telemetry") == 0)
+    {
+        uart_puts(commandsDetail[15]);
+    }
+    else if (strcmp(cmd, "help fillbench") == 0)
+    {
+        uart_puts(commandsDetail[16]);
+    }
+    else if (strcmp(cmd, "help blitbench") == 0)
+    {
+        uart_puts(commandsDetail[17]);
+    }
+    else if (strcmp(cmd, "help glyphbench") == 0)
+    {
+        uart_puts(commandsDetail[18]);
+    }
+    else if (strcmp(cmd, "help console") == 0)
+    {
+        uart_puts(commandsDetail[19]);
+    }
+    else if (strcmp(cmd, "help linebench") == 0)
+    {
+        uart_puts(commandsDetail[20]);
+    }
+    else if (strcmp(cmd, "help shapebench") == 0)
+    {
+        uart_puts(commandsDetail[21]);
+    }
     else if (strcmp(cmd, "showimage") == 0)
     {
+        cpufreq_busy_begin();
         clearScreen(0);
         // framebf_init(1024, 720);
         drawImage(image1image1, 0, 0, 480, 270);
+        fb_present();
+        cpufreq_busy_end();
     }
     else if (strcmp(cmd, "showlargeimage") == 0)
     {
-        clearScreen(0);
         // framebf_init(1024, 720);
-        drawLargeImageScroll();
+        drawLargeImageScroll(); // raises the clock only while drawing
     }
     else if (strcmp(cmd, "showvideo") == 0)
     {
+        cpufreq_busy_begin();
         clearScreen(0); 
         // framebf_init(1024, 720);
         playVideo();
+        cpufreq_busy_end();
     }
     else if (strcmp(cmd, "displaytext") == 0)
     {
+        cpufreq_busy_begin();
         clearScreen(0);
         drawOnScreen();
+        fb_present();
+        cpufreq_busy_end();
     }
 
     else if (strcmp(cmd, commands[1]) == 0)
@@ -503,7 +864,6 @@ void execute_command(char *cmd)
     else if (strcmp(cmd, commands[3]) == 0)
     {
         showBoardInfo();
-        getMacAddress();
     }
     else if (strcmp(cmd, commands[4]) == 0)
     {
@@ -514,9 +874,12 @@ void execute_command(char *cmd)
         printf("This is a Float number: %f \n", 0.21);
         printf("Hexadecimal: %x\n", 195);
     }
-    else if (strcmp(cmd, commands[5]) == 0)
+    else if (strncmp(cmd, commands[5], 12) == 0) // expandscreen command
     {
-        expandScreen();
+        char *w = strtok(cmd, " ");
+        w = strtok(NULL, " ");
+        char *h = strtok(NULL, " ");
+        expandScreen(w, h);
     }
     else if (strcmp(cmd, commands[6]) == 0)
     {
@@ -530,6 +893,72 @@ void execute_command(char *cmd)
     {
         getArmFrequency();
     }
+    else if (strncmp(cmd, commands[9], 8) == 0) // membench command
+    {
+        char *token = strtok(cmd, " ");
+        token = strtok(NULL, " ");
+        membench(token ? convert(token) : 1);
+    }
+    else if (strcmp(cmd, commands[10]) == 0)
+    {
+        strbench();
+    }
+    else if (strncmp(cmd, commands[11], 9) == 0) // mboxbench command
+    {
+        char *token = strtok(cmd, " ");
+        token = strtok(NULL, " ");
+        mboxbench(token ? convert(token) : 200);
+    }
+    else if (strncmp(cmd, commands[12], 9) == 0) // flipbench command
+    {
+        char *token = strtok(cmd, " ");
+        token = strtok(NULL, " ");
+        flipbench(token ? convert(token) : 50);
+    }
+    else if (strncmp(cmd, commands[13], 7) == 0) // cpufreq command
+    {
+        char *token = strtok(cmd, " ");
+        token = strtok(NULL, " ");
+        cpuFrequency(token);
+    }
+    else if (strncmp(cmd, commands[14], 4) == 0) // baud command
+    {
+        char *token = strtok(cmd, " ");
+        token = strtok(NULL, " ");
+        setBaudRate(token);
+    }
+    else if (strncmp(cmd, commands[15], 9) == 0) // telemetry command
+    {
+        char *token = strtok(cmd, " ");
+        token = strtok(NULL, " ");
+        showTelemetry(token);
+    }
+    else if (strcmp(cmd, commands[16]) == 0)
+    {
+        fillbench();
+    }
+    else if (strcmp(cmd, commands[17]) == 0)
+    {
+        blitbench();
+    }
+    else if (strcmp(cmd, commands[18]) == 0)
+    {
+        glyphbench();
+    }
+    else if (strncmp(cmd, commands[19], 7) == 0) // console command
+    {
+        char *token = strtok(cmd, " ");
+        token = strtok(NULL, " ");
+        framebufferConsole(token);
+    }
+    else if (strcmp(cmd, commands[20]) == 0)
+    {
+        linebench();
+    }
+    else if (strcmp(cmd, commands[21]) == 0)
+    {
+        shapebench();
+    }
     else
     {
         uart_puts("Unrecognized command!\n");
@@ -648,139 +1077,33 @@ void cli()
 
 void main()
 {
-    framebf_init(1024, 720);
+    // fetch the immutable board facts in one mailbox query
+    board_info_init();
+    // identity map memory and turn on the caches
+    mmu_init();
+    framebf_init(SCR_WIDTH, SCR_HEIGHT);
     // intitialize UART
     uart_init();
+    // release the secondary cores into their job loop
+    smp_init();
+    // take interrupts on core 0 and complete mailbox requests from them
+    irq_init();
+    mbox_irq_init();
+    // read the ARM clock limits and start the on-demand governor
+    cpufreq_init();
+    // sample temperature, clocks and throttling in the background
+    telemetry_start(TELEMETRY_PERIOD_MS);
     setcolor("red", "black");
     uart_puts(welcome_message);
     display_prompt();
     drawOnScreen();
+    fb_present();
 
     while (1)
     {
         cli();
     }
 }
-// some manual string functions (cannot include "string.h")
-int strlen(const char *str)
-{
-    const char *s = str;
-    while (*s)
-        ++s;
-    return s - str;
-}
-
-char *strcpy(char *dest, const char *src)
-{
-    char *save = dest;
-    while ((*dest++ = *src++))
-        ;
-    return save;
-}
-
-int strcmp(const char *str1, const char *str2)
-{
-    while (*str1 && (*str1 == *str2))
-    {
-        str1++;
-        str2++;
-    }
-    return *(unsigned char *)str1 - *(unsigned char *)str2;
-}
-
-int strncmp(const char *str1, const char *str2, int n)
-{
-    while (n && *str1 && (*str1 == *str2))
-    {
-        str1++;
-        str2++;
-        n--;
-    }
-    if (n == 0)
-        return 0;
-    return *(unsigned char *)str1 - *(unsigned char *)str2;
-}
-char *strtok(char *str, const char *delim)
-{
-    static char *next_token = NULL;
-    char *token_start;
-
-    // If the input string is NULL, continue tokenizing the previous string
-    if (str == NULL)
-    {
-        str = next_token;
-    }
-
-    // If the string is NULL or an empty string, return NULL
-    if (str == NULL || *str == '\0')
-    {
-        next_token = NULL;
-        return NULL;
-    }
-
-    // Tokenize and skip any leading delimiters
-    token_start = str + strspn(str, delim);
-    if (*token_start == '\0')
-    {
-        next_token = NULL;
-        return NULL;
-    }
-
-    // Find the end of the token
-    next_token = token_start + strcspn(token_start, delim);
-    if (*next_token == '\0')
-    {
-        next_token = NULL;
-    }
-    else
-    {
-        // Replace the following delimiter with a null terminator
-        *next_token = '\0';
-        next_token++;
-    }
-
-    return token_start;
-}
-
-int strspn(const char *str, const char *set)
-{
-    int len = 0;
-    while (*str && strchr(set, *str))
-    {
-        str++;
-        len++;
-    }
-    return len;
-}
-
-int strcspn(const char *str, const char *set)
-{
-    int len = 0;
-    while (*str && !strchr(set, *str))
-    {
-        str++;
-        len++;
-    }
-    return len;
-}
-
-char *strchr(const char *str, int c)
-{
-    while (*str)
-    {
-        if (*str == (char)c)
-        {
-            return (char *)str;
-        }
-        str++;
-    }
-    if (*str == (char)c)
-    {
-        return (char *)str;
-    }
-    return NULL;
-}
-
 int convert(char s[])
 {
     int i, n = 0;
@@ -1,9 +1,12 @@
 #include "mbox.h"
 #include "gpio.h"
 #include "uart1.h"
+#include "mmu.h"
+#include "irq.h"
+#include "spinlock.h"
 #include "./gcclib/stdint.h"
 
-/* Mailbox Data Buffer (each element is 32-bit)*/
+/* Mailbox Data Buffers (each element is 32-bit)*/
 /*
  * The keyword attribute allows you to specify special attributes
  *
@@ -17,90 +20,338 @@
  * so only the high 28 bits contain the address
  * (last 4 bits is ZERO due to 16 byte alignment)
  *
+ * The buffers live in the non-cacheable DMA pool (see link.ld), so they are
+ * always coherent with the VideoCore even when the data cache is on.
+ * Each one is MBOX_WORDS long, a multiple of 16 bytes.
  */
-void mbox_buffer_setup(unsigned int buffer_addr, unsigned int tag_identifier,
-					   unsigned int **res_data, unsigned int res_length,
-					   unsigned int req_length, unsigned int *request_values)
+static volatile unsigned int __attribute__((aligned(16), section(".dma_nc"))) mbox_pool[MBOX_POOL_SIZE][MBOX_WORDS];
+static unsigned int pool_used; // one bit per pool buffer
+
+/*
+ * Requests in flight. queue[] holds them in submission order: QUEUED ones
+ * wait for room in the ARM->VC mailbox, SENT ones for the VideoCore's reply.
+ */
+static struct mbox_request requests[MBOX_QUEUE_DEPTH];
+static struct mbox_request *queue[MBOX_QUEUE_DEPTH];
+static unsigned int queue_len;
+
+static volatile unsigned int mbox_lock;
+static volatile int mbox_irq_on;
+
+/*
+ * Take the mailbox lock with IRQs masked on this core. Before the MMU is on
+ * only core 0 runs, and exclusives would not work anyway, so skip the lock.
+ */
+static unsigned long mbox_lock_take()
 {
-	volatile unsigned int *mBuffer = (volatile unsigned int *)(uintptr_t)buffer_addr;
-	mBuffer[0] = 4 * sizeof(unsigned int) + req_length + res_length;
-	mBuffer[1] = MBOX_REQUEST;
-	mBuffer[2] = tag_identifier;
-	mBuffer[3] = req_length;
-	mBuffer[4] = res_length;
-	*res_data = &mBuffer[5];
+	unsigned long flags = irq_save();
+	if (mmu_enabled())
+		spin_lock(&mbox_lock);
+	return flags;
+}
+
+static void mbox_lock_give(unsigned long flags)
+{
+	if (mmu_enabled())
+		spin_unlock(&mbox_lock);
+	irq_restore(flags);
+}
 
-	for (int i = 0; i < req_length / sizeof(unsigned int); i++)
+/*
+ * Write queued requests, oldest first, while the ARM->VC mailbox has room
+ * (lock held)
+ */
+static void mbox_kick()
+{
+	for (unsigned int i = 0; i < queue_len; i++)
 	{
-		mBuffer[5 + i] = request_values[i];
+		struct mbox_request *req = queue[i];
+		if (req->state != MBOX_REQ_QUEUED)
+			continue;
+		if (*MBOX1_STATUS & MBOX_FULL)
+			break;
+		req->state = MBOX_REQ_SENT;
+		*MBOX1_WRITE = req->msg;
 	}
-	mBuffer[5 + (req_length / sizeof(unsigned int))] = MBOX_TAG_LAST;
 }
 
-volatile unsigned int __attribute__((aligned(16))) mbox[36];
-
 /**
- * Read from the mailbox
+ * Drain the VC->ARM mailbox, complete the matching requests and send any
+ * queued ones. Runs from the mailbox interrupt, or from waiters when
+ * interrupts are not available. Callbacks run after the lock is dropped,
+ * so they may submit new requests.
  */
-uint32_t mailbox_read(unsigned char channel)
+static void mbox_service()
 {
-	// Receiving message is buffer_addr & channel number
-	uint32_t res;
-	// Make sure that the message is from the right channel
-	do
+	struct mbox_request *finished[MBOX_QUEUE_DEPTH];
+	unsigned int nfinished = 0;
+	unsigned long flags = mbox_lock_take();
+
+	while (!(*MBOX0_STATUS & MBOX_EMPTY))
 	{
-		// Make sure there is mail to receive
-		do
+		unsigned int msg = *MBOX0_READ;
+
+		// A reply carries the address and channel of its request;
+		// replies nobody is waiting for are dropped
+		for (unsigned int i = 0; i < queue_len; i++)
 		{
-			asm volatile("nop");
-		} while (*MBOX0_STATUS & MBOX_EMPTY);
-		// Get the message
-		res = *MBOX0_READ;
-	} while ((res & 0xF) != channel);
+			struct mbox_request *req = queue[i];
+			if (req->state != MBOX_REQ_SENT || req->msg != msg)
+				continue;
+
+			for (unsigned int j = i + 1; j < queue_len; j++)
+				queue[j - 1] = queue[j];
+			queue_len--;
+
+			// Drop any stale cached copy before reading the response
+			dcache_invalidate_range((void *)req->buf, req->size);
+			req->result = (req->buf[1] == MBOX_RESPONSE);
+			asm volatile("dmb sy" ::: "memory");
+			req->state = MBOX_REQ_DONE;
+			if (req->callback)
+				finished[nfinished++] = req;
+			break;
+		}
+	}
+	mbox_kick();
+	mbox_lock_give(flags);
+
+	for (unsigned int i = 0; i < nfinished; i++)
+	{
+		finished[i]->callback(finished[i], finished[i]->ctx);
+		asm volatile("dmb sy" ::: "memory");
+		finished[i]->state = MBOX_REQ_FREE;
+	}
 
-	return res;
+	// Wake up waiters on other cores
+	asm volatile("dsb sy\n sev" ::: "memory");
 }
 
 /**
- * Write to the mailbox
+ * Complete requests from the mailbox interrupt instead of polling. Call
+ * after irq_init() on core 0.
  */
-void mailbox_send(uint32_t msg, unsigned char channel)
+void mbox_irq_init()
 {
-	// Sending message is buffer_addr & channel number
-	//  Make sure you can send mail
-	do
+	irq_enable_basic(IRQ_BASIC_MAILBOX, mbox_service);
+	*MBOX0_CONFIG = MBOX_CONFIG_DATA_IRQ;
+	mbox_irq_on = 1;
+}
+
+/**
+ * Take a message buffer from the pool (0 if they are all in use)
+ */
+volatile unsigned int *mbox_buf_alloc()
+{
+	volatile unsigned int *buf = 0;
+	unsigned long flags = mbox_lock_take();
+	for (unsigned int i = 0; i < MBOX_POOL_SIZE; i++)
 	{
-		asm volatile("nop");
-	} while (*MBOX1_STATUS & MBOX_FULL);
+		if (!(pool_used & (1 << i)))
+		{
+			pool_used |= 1 << i;
+			buf = mbox_pool[i];
+			break;
+		}
+	}
+	mbox_lock_give(flags);
+	return buf;
+}
 
-	// send the message
-	*MBOX1_WRITE = msg;
+void mbox_buf_free(volatile unsigned int *buf)
+{
+	if (buf < &mbox_pool[0][0] || buf >= &mbox_pool[0][0] + MBOX_POOL_SIZE * MBOX_WORDS)
+		return;
+
+	unsigned long i = (buf - &mbox_pool[0][0]) / MBOX_WORDS;
+	unsigned long flags = mbox_lock_take();
+	pool_used &= ~(1 << i);
+	mbox_lock_give(flags);
 }
 
 /**
- * Make a mailbox call. Returns 0 on failure, non-zero on success
+ * Queue a message (16-byte aligned, size in buf[0]) for the VideoCore and
+ * return at once. Returns 0 if MBOX_QUEUE_DEPTH requests are outstanding.
+ *
+ * Without a callback the handle must be passed to mbox_wait(). With one,
+ * callback(req, ctx) runs on completion (usually in interrupt context) and
+ * the handle is released right after it returns.
  */
-int mbox_call(unsigned int buffer_addr, unsigned char channel)
+struct mbox_request *mbox_submit(volatile unsigned int *buf, unsigned char channel,
+								 mbox_callback_t callback, void *ctx)
 {
-	// Check Buffer Address
-	//	uart_puts("Buffer Address: ");
-	//	uart_hex(buffer_addr);
-	//	uart_sendc('\n');
+	struct mbox_request *req = 0;
+	unsigned long flags = mbox_lock_take();
 
-	// Prepare Data (address of Message Buffer)
-	unsigned int msg = (buffer_addr & ~0xF) | (channel & 0xF);
-	mailbox_send(msg, channel);
+	for (unsigned int i = 0; i < MBOX_QUEUE_DEPTH; i++)
+	{
+		if (requests[i].state == MBOX_REQ_FREE)
+		{
+			req = &requests[i];
+			break;
+		}
+	}
 
-	/* now wait for the response */
-	/* is it a response to our message (same address)? */
-	if (msg == mailbox_read(channel))
+	if (req)
 	{
-		/* is it a valid successful response (Response Code) ? */
-		//		if (mbox[1] == MBOX_RESPONSE)
-		//			uart_puts("Got successful response \n");
+		req->buf = buf;
+		req->size = buf[0];
+		req->msg = (ADDR(buf) & ~0xF) | (channel & 0xF);
+		req->callback = callback;
+		req->ctx = ctx;
+		req->result = 0;
+		req->state = MBOX_REQ_QUEUED;
+		queue[queue_len++] = req;
+
+		// Push the request out of the data cache (for buffers in cacheable RAM)
+		dcache_clean_range((void *)buf, req->size);
+		mbox_kick();
+	}
+
+	mbox_lock_give(flags);
+	return req;
+}
+
+/**
+ * Non-zero once the VideoCore has answered the request
+ */
+int mbox_poll(struct mbox_request *req)
+{
+	int done = (req->state == MBOX_REQ_DONE);
+	asm volatile("dmb sy" ::: "memory");
+	return done;
+}
 
-		return (mbox[1] == MBOX_RESPONSE);
+/**
+ * Sleep until the request completes, then release the handle.
+ * Returns 0 on failure, non-zero on success
+ */
+int mbox_wait(struct mbox_request *req)
+{
+	while (!mbox_poll(req))
+	{
+		// The interrupt handler signals an event after each completion.
+		// Poll the mailbox instead when it cannot reach us.
+		if (mbox_irq_on && irq_enabled())
+			asm volatile("wfe");
+		else
+			mbox_service();
 	}
 
-	return 0;
+	int result = req->result;
+	asm volatile("dmb sy" ::: "memory");
+	req->state = MBOX_REQ_FREE;
+	return result;
+}
+
+/**
+ * Make a mailbox call and wait for the answer.
+ * Returns 0 on failure, non-zero on success
+ */
+int mbox_call(unsigned int buffer_addr, unsigned char channel)
+{
+	volatile unsigned int *buffer = (volatile unsigned int *)(uintptr_t)buffer_addr;
+	struct mbox_request *req;
+
+	// Wait for a free request slot if the queue is full
+	while (!(req = mbox_submit(buffer, channel, 0, 0)))
+		mbox_service();
+
+	return mbox_wait(req);
+}
+
+/**
+ * Start an empty property message in buf (16-byte aligned, words long)
+ */
+void mbox_msg_init(struct mbox_msg *msg, volatile unsigned int *buf, unsigned int words)
+{
+	msg->buf = buf;
+	msg->words = buf ? words : 0;
+	msg->pos = 2;
+	if (buf)
+		buf[1] = MBOX_REQUEST;
+}
+
+/**
+ * Start an empty property message in a buffer taken from the pool.
+ * If the pool is empty every tag is rejected and the send fails.
+ * Give the buffer back with mbox_msg_end().
+ */
+void mbox_msg_begin(struct mbox_msg *msg)
+{
+	mbox_msg_init(msg, mbox_buf_alloc(), MBOX_WORDS);
+}
+
+void mbox_msg_end(struct mbox_msg *msg)
+{
+	mbox_buf_free(msg->buf);
+	msg->buf = 0;
+	msg->words = 0;
+}
+
+/**
+ * Append a tag with req_words request values (may be NULL when 0) and room
+ * for res_words response values. Returns a handle for mbox_msg_value(),
+ * or -1 if the buffer is full.
+ */
+int mbox_msg_add(struct mbox_msg *msg, unsigned int tag, const unsigned int *values,
+				 unsigned int req_words, unsigned int res_words)
+{
+	unsigned int value_words = req_words > res_words ? req_words : res_words;
+
+	// keep one word for the end tag
+	if (msg->pos + 3 + value_words + 1 > msg->words)
+		return -1;
+
+	volatile unsigned int *t = &msg->buf[msg->pos];
+	t[0] = tag;				   // TAG Identifier
+	t[1] = value_words * 4;	   // Value buffer size in bytes
+	t[2] = MBOX_REQUEST;	   // REQUEST CODE = 0
+	for (unsigned int i = 0; i < value_words; i++)
+		t[3 + i] = (i < req_words) ? values[i] : 0;
+
+	int handle = msg->pos;
+	msg->pos += 3 + value_words;
+	return handle;
+}
+
+static void mbox_msg_finish(struct mbox_msg *msg)
+{
+	msg->buf[msg->pos] = MBOX_TAG_LAST;
+	msg->buf[0] = (msg->pos + 1) * 4; // Message Buffer Size in bytes
+	msg->buf[1] = MBOX_REQUEST;
+}
+
+/**
+ * Terminate the message and send it in one mailbox round trip.
+ * Returns 0 on failure, non-zero on success
+ */
+int mbox_msg_send(struct mbox_msg *msg)
+{
+	if (!msg->buf)
+		return 0;
+	mbox_msg_finish(msg);
+	return mbox_call(ADDR(msg->buf), MBOX_CH_PROP);
+}
+
+/**
+ * Terminate the message and queue it without waiting (see mbox_submit).
+ * The buffer must stay untouched until the request completes.
+ */
+struct mbox_request *mbox_msg_submit(struct mbox_msg *msg, mbox_callback_t callback, void *ctx)
+{
+	if (!msg->buf)
+		return 0;
+	mbox_msg_finish(msg);
+	return mbox_submit(msg->buf, MBOX_CH_PROP, callback, ctx);
+}
+
+/**
+ * Return the value slots of a tag, or 0 if the firmware did not answer it
+ */
+volatile unsigned int *mbox_msg_value(struct mbox_msg *msg, int tag)
+{
+	if (tag < 0 || !(msg->buf[tag + 2] & MBOX_RESPONSE))
+		return 0;
+	return &msg->buf[tag + 3];
 }
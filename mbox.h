@@ -1,8 +1,12 @@
 // -----------------------------------mbox.h -------------------------------------
+#ifndef MBOX_H
+#define MBOX_H
 #include "gpio.h"
 
-/* a properly aligned buffer */
-extern volatile unsigned int mbox[36];
+/* Pool of properly aligned message buffers, MBOX_WORDS each */
+#define MBOX_WORDS 64
+#define MBOX_POOL_SIZE 16
+#define MBOX_QUEUE_DEPTH 16 // requests in flight at once
 #define ADDR(X) (unsigned int)((unsigned long)X)
 
 // New Tags for Screen Display
@@ -35,6 +39,9 @@ extern volatile unsigned int mbox[36];
 #define MBOX_FULL 0x80000000
 #define MBOX_EMPTY 0x40000000
 
+// Config Value: raise an interrupt while the VC->ARM mailbox holds data
+#define MBOX_CONFIG_DATA_IRQ 0x1
+
 /* channels */
 #define MBOX_CH_POWER 0 // Power management
 #define MBOX_CH_FB 1    // Frame buffer
@@ -46,14 +53,88 @@ extern volatile unsigned int mbox[36];
 #define MBOX_CH_PROP 8  // Property tags (ARM -> VC)
 
 /* tags */
-#define MBOX_TAG_GETSERIAL 0x00010004 // Get board serial
-#define MBOX_TAG_GETMODEL 0x00010001  // Get board serial
+#define MBOX_TAG_GETMODEL 0x00010001    // Get board model
+#define MBOX_TAG_GETREVISION 0x00010002 // Get board revision
+#define MBOX_TAG_GETMAC 0x00010003      // Get board MAC address
+#define MBOX_TAG_GETSERIAL 0x00010004   // Get board serial
+#define MBOX_TAG_GETARMMEM 0x00010005 // Get ARM memory base and size
+#define MBOX_TAG_GETVCMEM 0x00010006  // Get VideoCore memory base and size
+#define MBOX_TAG_GETCLKRATE 0x00030002
+#define MBOX_TAG_GETVOLTAGE 0x00030003 // Get voltage (id 1 = core), in uV
+#define MBOX_TAG_GETTEMP 0x00030006 // Get SoC temperature in thousandths of a degree C
+#define MBOX_TAG_GETTHROTTLED 0x00030046 // Get under-voltage and throttling flags
+#define MBOX_TAG_GETMAXCLKRATE 0x00030004
+#define MBOX_TAG_GETMINCLKRATE 0x00030007
 #define MBOX_TAG_SETCLKRATE 0x00038002
 #define MBOX_TAG_LAST 0
 
+/* Property message being built in a mailbox buffer */
+struct mbox_msg
+{
+	volatile unsigned int *buf;
+	unsigned int words; // capacity of buf
+	unsigned int pos;	// index of the next tag
+};
+
+/* Typed views of common tag values (request and response share the slots) */
+struct mbox_clock
+{
+	unsigned int id;
+	unsigned int rate;
+};
+
+struct mbox_size
+{
+	unsigned int width;
+	unsigned int height;
+};
+
+struct mbox_range
+{
+	unsigned int base;
+	unsigned int size;
+};
+
+/* Request states */
+#define MBOX_REQ_FREE 0
+#define MBOX_REQ_QUEUED 1 // waiting for room in the mailbox
+#define MBOX_REQ_SENT 2	  // owned by the VideoCore
+#define MBOX_REQ_DONE 3
+
+struct mbox_request;
+typedef void (*mbox_callback_t)(struct mbox_request *req, void *ctx);
+
+/* Handle for a submitted message */
+struct mbox_request
+{
+	volatile unsigned int *buf;
+	unsigned int size; // bytes, from buf[0]
+	unsigned int msg;  // address and channel written to the mailbox
+	mbox_callback_t callback;
+	void *ctx;
+	volatile int state;
+	volatile int result; // non-zero if the firmware reported success
+};
+
+#define MBOX_VIEW(msg, tag, type) ((volatile type *)mbox_msg_value((msg), (tag)))
+
 /* Function Prototypes */
 int mbox_call(unsigned int buffer_addr, unsigned char channel);
+void mbox_irq_init();
+volatile unsigned int *mbox_buf_alloc();
+void mbox_buf_free(volatile unsigned int *buf);
+struct mbox_request *mbox_submit(volatile unsigned int *buf, unsigned char channel,
+								 mbox_callback_t callback, void *ctx);
+int mbox_poll(struct mbox_request *req);
+int mbox_wait(struct mbox_request *req);
+
+void mbox_msg_init(struct mbox_msg *msg, volatile unsigned int *buf, unsigned int words);
+void mbox_msg_begin(struct mbox_msg *msg);
+void mbox_msg_end(struct mbox_msg *msg);
+int mbox_msg_add(struct mbox_msg *msg, unsigned int tag, const unsigned int *values,
+				 unsigned int req_words, unsigned int res_words);
+int mbox_msg_send(struct mbox_msg *msg);
+struct mbox_request *mbox_msg_submit(struct mbox_msg *msg, mbox_callback_t callback, void *ctx);
+volatile unsigned int *mbox_msg_value(struct mbox_msg *msg, int tag);
 
-void mbox_buffer_setup(unsigned int buffer_addr, unsigned int tag_identifier,
-                       unsigned int **res_data, unsigned int res_length,
-                       unsigned int req_length, unsigned int *request_values);
\ No newline at end of file
+#endif
@@ -0,0 +1,172 @@
+// -----------------------------------mmu.c -------------------------------------
+#include "mmu.h"
+#include "board.h"
+#include "gpio.h"
+
+extern char __dma_nc_start[], __dma_nc_end[];
+
+/* Translation table descriptors (4 KB granule) */
+#define PT_BLOCK 0x1		 // block entry (1 GB at level 1, 2 MB at level 2)
+#define PT_TABLE 0x3		 // next level table
+#define PT_AF (1UL << 10)	 // access flag
+#define PT_ISH (3UL << 8)	 // inner shareable
+#define PT_PXN (1UL << 53) // privileged execute never
+#define PT_UXN (1UL << 54) // unprivileged execute never
+#define PT_ATTR(idx) ((unsigned long)(idx) << 2)
+
+#define L2_BLOCK_SIZE 0x200000UL
+#define LOCAL_PERIPHERALS 0x40000000UL // core timers, mailboxes, interrupt routing
+
+/* attr0 = normal WBWA, attr1 = device nGnRE, attr2 = normal non-cacheable */
+#define MAIR_VALUE ((0xFFUL << (8 * MT_NORMAL)) | (0x04UL << (8 * MT_DEVICE)) | (0x44UL << (8 * MT_NORMAL_NC)))
+
+/* 4 GB input range from level 1, walks cacheable and inner shareable, no TTBR1 */
+#define TCR_VALUE ((32UL << 0) | (1UL << 8) | (1UL << 10) | (3UL << 12) | (1UL << 23))
+
+#define SCTLR_M (1 << 0)  // MMU enable
+#define SCTLR_A (1 << 1)  // alignment check
+#define SCTLR_C (1 << 2)  // data cache enable
+#define SCTLR_I (1 << 12) // instruction cache enable
+
+static unsigned long __attribute__((aligned(4096))) l1_table[512];
+static unsigned long __attribute__((aligned(4096))) l2_table[512];
+
+/* Read by the secondary cores with their MMU still off */
+static volatile unsigned int mmu_on;
+
+static unsigned long dcache_line_size()
+{
+	unsigned long ctr;
+	asm volatile("mrs %0, ctr_el0"
+				 : "=r"(ctr));
+	return 4UL << ((ctr >> 16) & 0xF);
+}
+
+/**
+ * Write dirty lines in the range back to memory (DC CVAC)
+ */
+void dcache_clean_range(void *start, unsigned long size)
+{
+	unsigned long line = dcache_line_size();
+	unsigned long addr = (unsigned long)start & ~(line - 1);
+	unsigned long end = (unsigned long)start + size;
+
+	for (; addr < end; addr += line)
+		asm volatile("dc cvac, %0" ::"r"(addr)
+					 : "memory");
+	asm volatile("dsb sy" ::: "memory");
+}
+
+/**
+ * Discard cached copies of the range so the next read comes from memory
+ * (DC IVAC). Partial lines at either end are cleaned first (DC CIVAC) so
+ * neighbouring data sharing those lines is not lost.
+ */
+void dcache_invalidate_range(void *start, unsigned long size)
+{
+	unsigned long line = dcache_line_size();
+	unsigned long addr = (unsigned long)start & ~(line - 1);
+	unsigned long end = (unsigned long)start + size;
+
+	for (; addr < end; addr += line)
+	{
+		if (addr < (unsigned long)start || addr + line > end)
+			asm volatile("dc civac, %0" ::"r"(addr)
+						 : "memory");
+		else
+			asm volatile("dc ivac, %0" ::"r"(addr)
+						 : "memory");
+	}
+	asm volatile("dsb sy" ::: "memory");
+}
+
+/**
+ * Write back and discard the range (DC CIVAC)
+ */
+void dcache_clean_invalidate_range(void *start, unsigned long size)
+{
+	unsigned long line = dcache_line_size();
+	unsigned long addr = (unsigned long)start & ~(line - 1);
+	unsigned long end = (unsigned long)start + size;
+
+	for (; addr < end; addr += line)
+		asm volatile("dc civac, %0" ::"r"(addr)
+					 : "memory");
+	asm volatile("dsb sy" ::: "memory");
+}
+
+static void mmu_enable()
+{
+	unsigned long r;
+
+	asm volatile("msr mair_el1, %0" ::"r"(MAIR_VALUE));
+	asm volatile("msr tcr_el1, %0" ::"r"(TCR_VALUE));
+	asm volatile("msr ttbr0_el1, %0" ::"r"((unsigned long)l1_table));
+	asm volatile("tlbi vmalle1\n dsb ish\n isb" ::: "memory");
+
+	asm volatile("mrs %0, sctlr_el1"
+				 : "=r"(r));
+	r |= SCTLR_M | SCTLR_C | SCTLR_I;
+	r &= ~SCTLR_A; // allow unaligned accesses to normal memory
+	asm volatile("msr sctlr_el1, %0\n isb" ::"r"(r)
+				 : "memory");
+}
+
+/**
+ * Identity map the first 2 GB and turn on the MMU and caches:
+ *  - ARM RAM: cacheable, except the 2 MB DMA_COHERENT pool
+ *  - VideoCore RAM (framebuffer): non-cacheable, so writes reach the display
+ *  - peripherals and local peripherals: device memory
+ */
+void mmu_init()
+{
+	// Where the ARM/VideoCore memory split is (queried at boot)
+	unsigned long vc_base = MMIO_BASE - 0x4000000UL; // 64 MB GPU split by default
+	if (board_info()->arm_size != 0)
+		vc_base = (board_info()->arm_base + board_info()->arm_size) & ~(L2_BLOCK_SIZE - 1);
+
+	for (unsigned long i = 0; i < 512; i++)
+	{
+		unsigned long addr = i * L2_BLOCK_SIZE;
+		unsigned long attr;
+
+		if (addr >= MMIO_BASE)
+			attr = PT_ATTR(MT_DEVICE) | PT_PXN | PT_UXN;
+		else if (addr >= vc_base ||
+				 (addr >= (unsigned long)__dma_nc_start && addr < (unsigned long)__dma_nc_end))
+			attr = PT_ATTR(MT_NORMAL_NC) | PT_ISH;
+		else
+			attr = PT_ATTR(MT_NORMAL) | PT_ISH;
+
+		l2_table[i] = addr | attr | PT_AF | PT_BLOCK;
+	}
+	l1_table[0] = (unsigned long)l2_table | PT_TABLE;
+	l1_table[1] = LOCAL_PERIPHERALS | PT_ATTR(MT_DEVICE) | PT_PXN | PT_UXN | PT_AF | PT_BLOCK;
+
+	mmu_enable();
+	mmu_on = 1;
+
+	// Make the flag visible to cores that still run with the MMU off
+	dcache_clean_range((void *)&mmu_on, sizeof(mmu_on));
+}
+
+/**
+ * Called by each secondary core before touching shared data: use the
+ * tables built by core 0 so all cores see the same coherent memory
+ */
+void mmu_secondary_init()
+{
+	if (mmu_on)
+		mmu_enable();
+}
+
+/**
+ * Return non-zero if the calling core runs with the MMU and caches on
+ */
+int mmu_enabled()
+{
+	unsigned long r;
+	asm volatile("mrs %0, sctlr_el1"
+				 : "=r"(r));
+	return (r & (SCTLR_M | SCTLR_C)) == (SCTLR_M | SCTLR_C);
+}
@@ -0,0 +1,15 @@
+// -----------------------------------mmu.h -------------------------------------
+
+/* Memory attribute indexes in MAIR_EL1 */
+#define MT_NORMAL 0	   // Normal memory, write-back write-allocate cacheable
+#define MT_DEVICE 1	   // Device-nGnRE (peripherals)
+#define MT_NORMAL_NC 2 // Normal memory, non-cacheable (VideoCore shared)
+
+/* Function prototypes */
+void mmu_init();
+void mmu_secondary_init();
+int mmu_enabled();
+
+void dcache_clean_range(void *start, unsigned long size);
+void dcache_invalidate_range(void *start, unsigned long size);
+void dcache_clean_invalidate_range(void *start, unsigned long size);
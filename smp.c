@@ -0,0 +1,120 @@
+// -----------------------------------smp.c -------------------------------------
+#include "smp.h"
+#include "timer.h"
+#include "mmu.h"
+
+extern char _start[];
+extern volatile unsigned int smp_boot_ready; // defined in boot.S (.data)
+
+/* Release addresses polled by the firmware stub holding the secondary cores
+ * (RPI3), at 0xD8 (link.ld); a symbol rather than a cast constant, which the
+ * compiler takes for an out-of-bounds access */
+extern volatile unsigned long __spin_table[SMP_MAX_CORES];
+
+/* One pending job per secondary core */
+struct smp_job
+{
+	void (*fn)(void *);
+	void *arg;
+	volatile unsigned int pending;
+};
+
+static struct smp_job jobs[SMP_MAX_CORES];
+static volatile unsigned int online[SMP_MAX_CORES];
+
+static inline void smp_signal()
+{
+	asm volatile("dsb sy\n sev" ::: "memory");
+}
+
+/**
+ * Return the id (0-3) of the calling core
+ */
+unsigned int smp_core_id()
+{
+	unsigned long mpidr;
+	asm volatile("mrs %0, mpidr_el1"
+				 : "=r"(mpidr));
+	return mpidr & 3;
+}
+
+/**
+ * Release the secondary cores into smp_secondary_main().
+ * Cores started by the firmware stub are pointed at _start through the spin
+ * table; cores already parked in boot.S only wait for smp_boot_ready.
+ */
+void smp_init()
+{
+	online[0] = 1;
+	smp_boot_ready = 1;
+
+	for (unsigned int core = 1; core < SMP_MAX_CORES; core++)
+		__spin_table[core] = (unsigned long)_start;
+
+	// The parked cores read these with their MMU (and caches) still off
+	dcache_clean_range((void *)&smp_boot_ready, sizeof(smp_boot_ready));
+	dcache_clean_range((void *)__spin_table, sizeof(__spin_table));
+	smp_signal();
+
+	// Give the cores 10 ms to report in
+	uint64_t deadline = timer_counter() + timer_frequency() / 100;
+	for (unsigned int core = 1; core < SMP_MAX_CORES; core++)
+		while (!online[core] && timer_counter() < deadline)
+			;
+}
+
+/**
+ * Return non-zero if the core is running its job loop
+ */
+int smp_core_online(unsigned int core)
+{
+	return core < SMP_MAX_CORES && online[core];
+}
+
+/**
+ * Run fn(arg) on a secondary core. Returns 0 if the core is offline or busy.
+ */
+int smp_start_core(unsigned int core, void (*fn)(void *), void *arg)
+{
+	if (core == 0 || !smp_core_online(core) || jobs[core].pending)
+		return 0;
+
+	jobs[core].fn = fn;
+	jobs[core].arg = arg;
+	asm volatile("dmb sy" ::: "memory");
+	jobs[core].pending = 1;
+	smp_signal();
+	return 1;
+}
+
+/**
+ * Wait until the job started on a secondary core has finished
+ */
+void smp_wait_core(unsigned int core)
+{
+	while (core < SMP_MAX_CORES && jobs[core].pending)
+		asm volatile("wfe");
+}
+
+/**
+ * Job loop of the secondary cores (entered from boot.S)
+ */
+void smp_secondary_main(unsigned int core)
+{
+	mmu_secondary_init();
+	online[core] = 1;
+	smp_signal();
+
+	while (1)
+	{
+		while (!jobs[core].pending)
+			asm volatile("wfe");
+
+		asm volatile("dmb sy" ::: "memory");
+		jobs[core].fn(jobs[core].arg);
+
+		asm volatile("dmb sy" ::: "memory");
+		jobs[core].pending = 0;
+		smp_signal();
+	}
+}
@@ -0,0 +1,12 @@
+// -----------------------------------smp.h -------------------------------------
+
+#define SMP_MAX_CORES 4
+
+
+/* Function prototypes */
+void smp_init();
+unsigned int smp_core_id();
+int smp_core_online(unsigned int core);
+int smp_start_core(unsigned int core, void (*fn)(void *), void *arg);
+void smp_wait_core(unsigned int core);
+void smp_secondary_main(unsigned int core);
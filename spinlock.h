@@ -0,0 +1,48 @@
+// -----------------------------------spinlock.h -------------------------------------
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+/*
+ * Exclusive-access spinlock. Waiters sleep in WFE; the store-release in
+ * spin_unlock clears their exclusive monitor, which wakes them up.
+ * Exclusives need cacheable memory, so only use these once the MMU is on.
+ */
+static inline void spin_lock(volatile unsigned int *lock)
+{
+	unsigned int tmp;
+	asm volatile("   sevl\n"
+				 "1: wfe\n"
+				 "2: ldaxr   %w0, [%1]\n"
+				 "   cbnz    %w0, 1b\n"
+				 "   stxr    %w0, %w2, [%1]\n"
+				 "   cbnz    %w0, 2b\n"
+				 : "=&r"(tmp)
+				 : "r"(lock), "r"(1)
+				 : "memory");
+}
+
+static inline void spin_unlock(volatile unsigned int *lock)
+{
+	asm volatile("stlr wzr, [%0]" ::"r"(lock)
+				 : "memory");
+}
+
+/* Mask IRQs on this core and return the previous mask state */
+static inline unsigned long irq_save()
+{
+	unsigned long flags;
+	asm volatile("mrs %0, daif\n"
+				 "msr daifset, #2"
+				 : "=r"(flags)
+				 :
+				 : "memory");
+	return flags;
+}
+
+static inline void irq_restore(unsigned long flags)
+{
+	asm volatile("msr daif, %0" ::"r"(flags)
+				 : "memory");
+}
+
+#endif
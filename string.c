@@ -0,0 +1,345 @@
+// -----------------------------------string.c -------------------------------------
+#include "string.h"
+#include "./gcclib/stdint.h"
+
+#define NULL ((void *)0)
+
+/*
+ * Word-at-a-time (SWAR) helpers.
+ * Loads are always naturally aligned, so reading past the terminating zero
+ * never crosses into the next page. The may_alias attribute makes it legal
+ * to read char data through a 64-bit type.
+ */
+typedef unsigned long __attribute__((may_alias)) word_t;
+
+#define ONES 0x0101010101010101UL
+#define HIGHS 0x8080808080808080UL
+
+/* Non-zero if any byte of v is zero; the lowest flagged byte is always exact */
+#define ZERO_BYTES(v) (((v) - ONES) & ~(v) & HIGHS)
+
+/* Index of the first flagged byte (little endian) */
+#define FIRST_BYTE(mask) (__builtin_ctzl(mask) >> 3)
+
+/*
+ * NEON helpers: compare one 16-byte aligned chunk and turn the 16 byte lane
+ * results into a 64-bit mask with 4 bits per byte (SHRN narrowing trick).
+ */
+static inline unsigned long neon_zero_mask(const char *p)
+{
+	unsigned long mask;
+	asm volatile("ld1 {v0.16b}, [%1]\n"
+				 "cmeq v0.16b, v0.16b, #0\n"
+				 "shrn v0.8b, v0.8h, #4\n"
+				 "fmov %0, d0"
+				 : "=r"(mask)
+				 : "r"(p)
+				 : "v0", "memory");
+	return mask;
+}
+
+static inline unsigned long neon_zero_or_char_mask(const char *p, unsigned int c)
+{
+	unsigned long mask;
+	asm volatile("ld1 {v0.16b}, [%1]\n"
+				 "dup v1.16b, %w2\n"
+				 "cmeq v1.16b, v0.16b, v1.16b\n"
+				 "cmeq v0.16b, v0.16b, #0\n"
+				 "orr v0.16b, v0.16b, v1.16b\n"
+				 "shrn v0.8b, v0.8h, #4\n"
+				 "fmov %0, d0"
+				 : "=r"(mask)
+				 : "r"(p), "r"(c)
+				 : "v0", "v1", "memory");
+	return mask;
+}
+
+/* 256-bit membership table for the span functions */
+static void build_set(unsigned long table[4], const char *set)
+{
+	table[0] = table[1] = table[2] = table[3] = 0;
+	while (*set)
+	{
+		unsigned char b = *set++;
+		table[b >> 6] |= 1UL << (b & 63);
+	}
+}
+
+#define IN_SET(table, b) (((table)[(b) >> 6] >> ((b) & 63)) & 1)
+
+/* ------------------------------- strlen ------------------------------- */
+
+int strlen_bytewise(const char *str)
+{
+	const char *s = str;
+	while (*s)
+		++s;
+	return s - str;
+}
+
+int strlen_swar(const char *str)
+{
+	const char *s = str;
+
+	// Byte steps up to the first 8-byte boundary
+	for (; (uintptr_t)s & 7; s++)
+		if (!*s)
+			return s - str;
+
+	const word_t *w = (const word_t *)s;
+	unsigned long zeros;
+	while (!(zeros = ZERO_BYTES(*w)))
+		w++;
+
+	return (const char *)w - str + FIRST_BYTE(zeros);
+}
+
+int strlen_neon(const char *str)
+{
+	const char *p = (const char *)((uintptr_t)str & ~15UL);
+
+	// Ignore the bytes of the first chunk that come before str
+	unsigned long mask = neon_zero_mask(p) >> (((uintptr_t)str & 15) * 4);
+	if (mask)
+		return __builtin_ctzl(mask) >> 2;
+
+	do
+	{
+		p += 16;
+		mask = neon_zero_mask(p);
+	} while (!mask);
+
+	return p - str + (__builtin_ctzl(mask) >> 2);
+}
+
+/**
+ * Strings handled by the kernel are mostly short command words, where the
+ * SWAR version wins over NEON (see strbench)
+ */
+int strlen(const char *str)
+{
+	return strlen_swar(str);
+}
+
+/* ------------------------------- strchr ------------------------------- */
+
+char *strchr_bytewise(const char *str, int c)
+{
+	while (*str)
+	{
+		if (*str == (char)c)
+		{
+			return (char *)str;
+		}
+		str++;
+	}
+	if (*str == (char)c)
+	{
+		return (char *)str;
+	}
+	return NULL;
+}
+
+char *strchr_swar(const char *str, int c)
+{
+	for (; (uintptr_t)str & 7; str++)
+	{
+		if (*str == (char)c)
+			return (char *)str;
+		if (!*str)
+			return NULL;
+	}
+
+	// Stop on the first word holding either a zero or c
+	unsigned long pattern = ONES * (unsigned char)c;
+	const word_t *w = (const word_t *)str;
+	while (!ZERO_BYTES(*w) && !ZERO_BYTES(*w ^ pattern))
+		w++;
+
+	return strchr_bytewise((const char *)w, c);
+}
+
+char *strchr_neon(const char *str, int c)
+{
+	const char *p = (const char *)((uintptr_t)str & ~15UL);
+	unsigned int ch = (unsigned char)c;
+	unsigned long mask = neon_zero_or_char_mask(p, ch) >> (((uintptr_t)str & 15) * 4);
+
+	if (mask)
+		p = str;
+	else
+	{
+		do
+		{
+			p += 16;
+			mask = neon_zero_or_char_mask(p, ch);
+		} while (!mask);
+	}
+
+	p += __builtin_ctzl(mask) >> 2;
+	return *p == (char)c ? (char *)p : NULL;
+}
+
+char *strchr(const char *str, int c)
+{
+	return strchr_swar(str, c);
+}
+
+/* ---------------------------- strcmp/strncmp ---------------------------- */
+
+int strcmp_bytewise(const char *str1, const char *str2)
+{
+	while (*str1 && (*str1 == *str2))
+	{
+		str1++;
+		str2++;
+	}
+	return *(unsigned char *)str1 - *(unsigned char *)str2;
+}
+
+int strcmp(const char *str1, const char *str2)
+{
+	// Compare whole words when both strings share the same alignment
+	if ((((uintptr_t)str1 ^ (uintptr_t)str2) & 7) == 0)
+	{
+		for (; (uintptr_t)str1 & 7; str1++, str2++)
+			if (!*str1 || *str1 != *str2)
+				return *(unsigned char *)str1 - *(unsigned char *)str2;
+
+		const word_t *w1 = (const word_t *)str1;
+		const word_t *w2 = (const word_t *)str2;
+		while (*w1 == *w2 && !ZERO_BYTES(*w1))
+		{
+			w1++;
+			w2++;
+		}
+		str1 = (const char *)w1;
+		str2 = (const char *)w2;
+	}
+
+	// Finish inside the word that differs or ends the string
+	return strcmp_bytewise(str1, str2);
+}
+
+int strncmp(const char *str1, const char *str2, int n)
+{
+	if ((((uintptr_t)str1 ^ (uintptr_t)str2) & 7) == 0)
+	{
+		for (; n && ((uintptr_t)str1 & 7); str1++, str2++, n--)
+			if (!*str1 || *str1 != *str2)
+				return *(unsigned char *)str1 - *(unsigned char *)str2;
+
+		const word_t *w1 = (const word_t *)str1;
+		const word_t *w2 = (const word_t *)str2;
+		while (n >= 8 && *w1 == *w2 && !ZERO_BYTES(*w1))
+		{
+			w1++;
+			w2++;
+			n -= 8;
+		}
+		str1 = (const char *)w1;
+		str2 = (const char *)w2;
+	}
+
+	while (n && *str1 && (*str1 == *str2))
+	{
+		str1++;
+		str2++;
+		n--;
+	}
+	if (n == 0)
+		return 0;
+	return *(unsigned char *)str1 - *(unsigned char *)str2;
+}
+
+/* --------------------------- strspn/strcspn --------------------------- */
+
+/**
+ * Original O(n*m) version: one strchr over the set per character
+ */
+int strspn_bytewise(const char *str, const char *set)
+{
+	int len = 0;
+	while (*str && strchr_bytewise(set, *str))
+	{
+		str++;
+		len++;
+	}
+	return len;
+}
+
+int strspn(const char *str, const char *set)
+{
+	unsigned long table[4];
+	build_set(table, set);
+
+	// '\0' is never in the table, so the scan stops at the end of str
+	const unsigned char *s = (const unsigned char *)str;
+	while (IN_SET(table, *s))
+		s++;
+	return (const char *)s - str;
+}
+
+int strcspn(const char *str, const char *set)
+{
+	unsigned long table[4];
+	build_set(table, set);
+	table[0] |= 1; // stop at the end of str
+
+	const unsigned char *s = (const unsigned char *)str;
+	while (!IN_SET(table, *s))
+		s++;
+	return (const char *)s - str;
+}
+
+/* ---------------------------- strcpy/strtok ---------------------------- */
+
+char *strcpy(char *dest, const char *src)
+{
+	char *save = dest;
+	while ((*dest++ = *src++))
+		;
+	return save;
+}
+
+char *strtok(char *str, const char *delim)
+{
+	static char *next_token = NULL;
+	char *token_start;
+
+	// If the input string is NULL, continue tokenizing the previous string
+	if (str == NULL)
+	{
+		str = next_token;
+	}
+
+	// If the string is NULL or an empty string, return NULL
+	if (str == NULL || *str == '\0')
+	{
+		next_token = NULL;
+		return NULL;
+	}
+
+	// Tokenize and skip any leading delimiters
+	token_start = str + strspn(str, delim);
+	if (*token_start == '\0')
+	{
+		next_token = NULL;
+		return NULL;
+	}
+
+	// Find the end of the token
+	next_token = token_start + strcspn(token_start, delim);
+	if (*next_token == '\0')
+	{
+		next_token = NULL;
+	}
+	else
+	{
+		// Replace the following delimiter with a null terminator
+		*next_token = '\0';
+		next_token++;
+	}
+
+	return token_start;
+}
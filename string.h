@@ -0,0 +1,21 @@
+// -----------------------------------string.h -------------------------------------
+/* Manual string functions (no libc, so we cannot use the standard string.h) */
+
+int strlen(const char *str);
+char *strcpy(char *dest, const char *src);
+int strcmp(const char *str1, const char *str2);
+int strncmp(const char *str1, const char *str2, int n);
+char *strtok(char *str, const char *delim);
+int strspn(const char *str, const char *set);
+int strcspn(const char *str, const char *set);
+char *strchr(const char *str, int c);
+
+/* Individual implementations, exposed for strbench */
+int strlen_bytewise(const char *str);
+int strlen_swar(const char *str);
+int strlen_neon(const char *str);
+char *strchr_bytewise(const char *str, int c);
+char *strchr_swar(const char *str, int c);
+char *strchr_neon(const char *str, int c);
+int strcmp_bytewise(const char *str1, const char *str2);
+int strspn_bytewise(const char *str, const char *set);
@@ -0,0 +1,226 @@
+// -----------------------------------telemetry.c -------------------------------------
+#include "telemetry.h"
+#include "timer.h"
+#include "mbox.h"
+#include "board.h"
+#include "spinlock.h"
+#include "irq.h"
+
+/* Samples, oldest overwritten first */
+static struct telemetry_sample ring[TELEMETRY_SAMPLES];
+static unsigned int ring_head; // next slot to write
+static unsigned int ring_count;
+
+static volatile unsigned int *buf; // pool buffer owned while running
+static unsigned int period_ms;
+static volatile int in_flight;
+static uint64_t request_time;
+static int tag_temp, tag_arm, tag_core, tag_volts, tag_throttled;
+
+/* Cost of the sampler: ticks spent in its interrupts, entry to exit (see
+ * irq_charge), or in the callback when it completes outside one */
+static uint64_t overhead_ticks;
+static unsigned int overhead_runs;
+static unsigned int dropped; // ticks skipped because a request was in flight
+
+static unsigned int telemetry_value(struct mbox_msg *msg, int tag, int index)
+{
+	volatile unsigned int *value = mbox_msg_value(msg, tag);
+	return value ? value[index] : 0;
+}
+
+/*
+ * Mailbox completion (interrupt context): store the sample
+ */
+static void telemetry_done(struct mbox_request *req, void *ctx)
+{
+	uint64_t start = timer_counter();
+	int charged = irq_charge(&overhead_ticks);
+	struct mbox_msg *msg = ctx;
+	struct telemetry_sample *s = &ring[ring_head];
+
+	s->time = request_time;
+	s->temp = telemetry_value(msg, tag_temp, 1);
+	s->arm_rate = telemetry_value(msg, tag_arm, 1);
+	s->core_rate = telemetry_value(msg, tag_core, 1);
+	s->core_volts = telemetry_value(msg, tag_volts, 1);
+	s->throttled = telemetry_value(msg, tag_throttled, 0);
+
+	ring_head = (ring_head + 1) % TELEMETRY_SAMPLES;
+	if (ring_count < TELEMETRY_SAMPLES)
+		ring_count++;
+	in_flight = 0;
+
+	if (!charged)
+		overhead_ticks += timer_counter() - start; // polled from mbox_wait()
+}
+
+/*
+ * Timer tick (interrupt context): queue one batched query without waiting
+ */
+static void telemetry_tick()
+{
+	static struct mbox_msg msg;
+	unsigned int temp_id[2] = {0, 0};
+	unsigned int arm_id[2] = {CLOCK_ARM, 0};
+	unsigned int core_id[2] = {CLOCK_CORE, 0};
+	unsigned int volts_id[2] = {1, 0}; // core voltage
+	unsigned int throttled_req = 0;
+
+	irq_charge(&overhead_ticks);
+	if (in_flight)
+	{
+		dropped++;
+		return;
+	}
+
+	mbox_msg_init(&msg, buf, MBOX_WORDS);
+	tag_temp = mbox_msg_add(&msg, MBOX_TAG_GETTEMP, temp_id, 2, 2);
+	tag_arm = mbox_msg_add(&msg, MBOX_TAG_GETCLKRATE, arm_id, 2, 2);
+	tag_core = mbox_msg_add(&msg, MBOX_TAG_GETCLKRATE, core_id, 2, 2);
+	tag_volts = mbox_msg_add(&msg, MBOX_TAG_GETVOLTAGE, volts_id, 2, 2);
+	tag_throttled = mbox_msg_add(&msg, MBOX_TAG_GETTHROTTLED, &throttled_req, 1, 1);
+
+	request_time = timer_counter();
+	in_flight = 1;
+	if (!mbox_msg_submit(&msg, telemetry_done, &msg))
+	{
+		in_flight = 0;
+		dropped++;
+	}
+	overhead_runs++;
+}
+
+/**
+ * Start sampling every period_ms from the core 0 timer interrupt.
+ * Returns 0 if no mailbox buffer is free.
+ */
+int telemetry_start(unsigned int ms)
+{
+	if (ms == 0)
+		return 0;
+	if (!buf && !(buf = mbox_buf_alloc()))
+		return 0;
+
+	period_ms = ms;
+	timer_tick_start(ms * 1000, telemetry_tick);
+	return 1;
+}
+
+/**
+ * Stop sampling and give the buffer back once the last request is done
+ */
+void telemetry_stop()
+{
+	timer_tick_stop();
+	period_ms = 0;
+	while (in_flight)
+		asm volatile("wfe");
+	mbox_buf_free(buf);
+	buf = 0;
+}
+
+/**
+ * Suspend sampling, e.g. while a benchmark times mailbox calls that would
+ * otherwise queue behind a sample. Returns the period to hand back to
+ * telemetry_resume() (0 if the sampler was not running).
+ */
+unsigned int telemetry_pause()
+{
+	unsigned int ms = period_ms;
+	if (ms)
+		telemetry_stop();
+	return ms;
+}
+
+void telemetry_resume(unsigned int ms)
+{
+	if (ms)
+		telemetry_start(ms);
+}
+
+int telemetry_running()
+{
+	return period_ms != 0;
+}
+
+unsigned int telemetry_period()
+{
+	return period_ms;
+}
+
+/**
+ * Number of samples held in the ring
+ */
+unsigned int telemetry_count()
+{
+	return ring_count;
+}
+
+/**
+ * Copy a sample out of the ring, age 0 being the newest.
+ * Returns 0 if there is no such sample.
+ */
+int telemetry_get(unsigned int age, struct telemetry_sample *out)
+{
+	unsigned long flags = irq_save(); // the ring is written from interrupts
+	int ok = age < ring_count;
+	if (ok)
+		*out = ring[(ring_head + TELEMETRY_SAMPLES - 1 - age) % TELEMETRY_SAMPLES];
+	irq_restore(flags);
+	return ok;
+}
+
+/*
+ * Query the throttling flags now, outside the sampler (0 if the call fails)
+ */
+static unsigned int telemetry_throttled_now()
+{
+	struct mbox_msg msg;
+	unsigned int req = 0, flags = 0;
+
+	mbox_msg_begin(&msg);
+	int tag = mbox_msg_add(&msg, MBOX_TAG_GETTHROTTLED, &req, 1, 1);
+	if (mbox_msg_send(&msg))
+		flags = telemetry_value(&msg, tag, 0);
+	mbox_msg_end(&msg);
+	return flags;
+}
+
+/**
+ * Non-zero if the SoC was throttled or frequency capped at some point from
+ * time (counter ticks) until now. Benchmarks use this to flag results.
+ * Samples are a period apart and most runs are far shorter, so besides the
+ * samples taken since time this checks the newest one before it (the state
+ * the run started in) and queries the firmware for the state at the end.
+ */
+int telemetry_throttled_since(uint64_t time)
+{
+	struct telemetry_sample s;
+	for (unsigned int age = 0; telemetry_get(age, &s); age++)
+	{
+		if (s.throttled & THROTTLE_NOW_MASK)
+			return 1;
+		if (s.time < time)
+			break;
+	}
+	return (telemetry_throttled_now() & THROTTLE_NOW_MASK) != 0;
+}
+
+/**
+ * Average CPU time spent per sample: the whole timer and mailbox interrupts
+ * that serve it, including the register frame saved on entry and restored
+ * on exit
+ */
+unsigned long telemetry_overhead_ns()
+{
+	return overhead_runs ? timer_ticks_to_ns(overhead_ticks / overhead_runs) : 0;
+}
+
+/**
+ * Ticks skipped because the previous query had not come back
+ */
+unsigned int telemetry_dropped()
+{
+	return dropped;
+}
@@ -0,0 +1,35 @@
+// -----------------------------------telemetry.h -------------------------------------
+#include "./gcclib/stdint.h"
+
+#define TELEMETRY_SAMPLES 256		// ring size
+#define TELEMETRY_PERIOD_MS 1000	// default sampling period
+
+/* Bits of the throttled field (MBOX_TAG_GETTHROTTLED) */
+#define THROTTLE_UNDERVOLT (1 << 0)
+#define THROTTLE_FREQ_CAPPED (1 << 1)
+#define THROTTLE_ACTIVE (1 << 2)
+#define THROTTLE_SOFT_TEMP (1 << 3)
+#define THROTTLE_NOW_MASK 0xF
+
+struct telemetry_sample
+{
+	uint64_t time;			 // counter ticks when the sample was requested
+	unsigned int temp;		 // thousandths of a degree C
+	unsigned int arm_rate;	 // Hz
+	unsigned int core_rate;	 // Hz
+	unsigned int core_volts; // microvolts
+	unsigned int throttled;	 // THROTTLE_* flags
+};
+
+/* Function prototypes */
+int telemetry_start(unsigned int period_ms);
+void telemetry_stop();
+unsigned int telemetry_pause();
+void telemetry_resume(unsigned int period_ms);
+int telemetry_running();
+unsigned int telemetry_period();
+unsigned int telemetry_count();
+int telemetry_get(unsigned int age, struct telemetry_sample *out);
+int telemetry_throttled_since(uint64_t time);
+unsigned long telemetry_overhead_ns();
+unsigned int telemetry_dropped();
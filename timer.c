@@ -0,0 +1,91 @@
+// -----------------------------------timer.c -------------------------------------
+#include "timer.h"
+#include "irq.h"
+
+#define CNTP_CTL_ENABLE 1
+
+static void (*tick_fn)(void);
+static uint64_t tick_period;
+
+/**
+ * Convert counter ticks to nanoseconds (split to avoid 64-bit overflow)
+ */
+uint64_t timer_ticks_to_ns(uint64_t ticks)
+{
+    uint64_t f = timer_frequency();
+    return (ticks / f) * 1000000000UL + ((ticks % f) * 1000000000UL) / f;
+}
+
+/**
+ * Convert counter ticks to microseconds
+ */
+uint64_t timer_ticks_to_us(uint64_t ticks)
+{
+    uint64_t f = timer_frequency();
+    return (ticks / f) * 1000000UL + ((ticks % f) * 1000000UL) / f;
+}
+
+/**
+ * Busy-wait on the generic timer counter
+ */
+void wait_ms(unsigned int n)
+{
+    register unsigned long f, t, r;
+
+    // Get the current counter frequency
+    asm volatile("mrs %0, cntfrq_el0"
+                 : "=r"(f));
+    // Read the current counter
+    asm volatile("mrs %0, cntpct_el0"
+                 : "=r"(t));
+    // Calculate expire value for counter
+    t += ((f / 1000) * n) / 1000;
+    do
+    {
+        asm volatile("mrs %0, cntpct_el0"
+                     : "=r"(r));
+    } while (r < t);
+}
+
+/*
+ * EL1 physical timer interrupt: schedule the next tick on the same grid
+ * (no drift), or from now if the handler fell more than a period behind
+ */
+static void timer_tick_irq()
+{
+    uint64_t next;
+    asm volatile("mrs %0, cntp_cval_el0"
+                 : "=r"(next));
+    next += tick_period;
+    if (next <= timer_counter())
+        next = timer_counter() + tick_period;
+    asm volatile("msr cntp_cval_el0, %0" ::"r"(next));
+
+    if (tick_fn)
+        tick_fn();
+}
+
+/**
+ * Call fn every period_us microseconds from the core 0 timer interrupt.
+ * Must run on core 0 after irq_init().
+ */
+void timer_tick_start(unsigned int period_us, void (*fn)(void))
+{
+    tick_fn = fn;
+    tick_period = timer_frequency() * period_us / 1000000;
+
+    irq_enable_local(0, IRQ_LOCAL_CNTPNS, timer_tick_irq);
+    asm volatile("msr cntp_cval_el0, %0" ::"r"(timer_counter() + tick_period));
+    asm volatile("msr cntp_ctl_el0, %0" ::"r"((unsigned long)CNTP_CTL_ENABLE));
+    CORE_TIMER_IRQCNTL(0) |= 1 << IRQ_LOCAL_CNTPNS;
+}
+
+/**
+ * Stop the periodic tick
+ */
+void timer_tick_stop()
+{
+    asm volatile("msr cntp_ctl_el0, xzr");
+    CORE_TIMER_IRQCNTL(0) &= ~(1 << IRQ_LOCAL_CNTPNS);
+    tick_fn = 0;
+}
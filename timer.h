@@ -0,0 +1,30 @@
+// -----------------------------------timer.h -------------------------------------
+#include "./gcclib/stdint.h"
+
+/* Read the ARM generic timer counter (ticks at cntfrq_el0 Hz) */
+static inline uint64_t timer_counter(void)
+{
+    uint64_t t;
+    // isb keeps the read from being hoisted above the code being timed
+    asm volatile("isb\n mrs %0, cntpct_el0"
+                 : "=r"(t)
+                 :
+                 : "memory");
+    return t;
+}
+
+/* Read the counter frequency in Hz */
+static inline uint64_t timer_frequency(void)
+{
+    uint64_t f;
+    asm volatile("mrs %0, cntfrq_el0"
+                 : "=r"(f));
+    return f;
+}
+
+/* Function prototypes */
+uint64_t timer_ticks_to_ns(uint64_t ticks);
+uint64_t timer_ticks_to_us(uint64_t ticks);
+void wait_ms(unsigned int n);
+void timer_tick_start(unsigned int period_us, void (*fn)(void));
+void timer_tick_stop();
@@ -1,4 +1,91 @@
 #include "uart1.h"
+#include "board.h"
+#include "console.h"
+
+static unsigned int uart_baud = UART_DEFAULT_BAUD;
+static unsigned int uart_clock; // core clock the divisor was derived from
+
+/**
+ * Mini UART clock: the VPU core clock, which the firmware may change
+ */
+static unsigned int uart_core_clock()
+{
+    unsigned int clock = board_clock_rate(CLOCK_CORE);
+    return clock ? clock : 250000000; // firmware default
+}
+
+/**
+ * Program AUX_MU_BAUD for the current baud rate and core clock
+ * [system_clk_freq/(baud_rate*8) - 1], rounded to the nearest divisor
+ */
+static void uart_program_divisor()
+{
+    unsigned int div = (uart_clock + 4 * uart_baud) / (8 * uart_baud);
+    AUX_MU_BAUD = div ? div - 1 : 0;
+}
+
+/**
+ * Let the transmitter drain so a divisor change does not garble output
+ */
+static void uart_flush()
+{
+    while (!(AUX_MU_LSR & 0x40))
+        asm volatile("nop");
+}
+
+/**
+ * Whether baud can be produced from the current core clock: at most clock/8,
+ * and not so low that the divisor overflows the 16-bit AUX_MU_BAUD
+ */
+int uart_baud_supported(unsigned int baud)
+{
+    unsigned int clock = uart_core_clock();
+    return baud != 0 && baud <= clock / 8 && (clock + 4 * baud) / (8 * baud) <= 65536;
+}
+
+/**
+ * Switch to a new baud rate. Returns the rate actually produced by the
+ * divisor (0 if uart_baud_supported() rejects baud).
+ */
+unsigned int uart_set_baud(unsigned int baud)
+{
+    if (!uart_baud_supported(baud))
+        return 0;
+
+    unsigned int clock = uart_core_clock();
+
+    uart_flush();
+    uart_baud = baud;
+    uart_clock = clock;
+    uart_program_divisor();
+    return uart_get_baud();
+}
+
+/**
+ * Baud rate produced by the current divisor
+ */
+unsigned int uart_get_baud()
+{
+    return uart_clock / (8 * (AUX_MU_BAUD + 1));
+}
+
+/**
+ * Called after a clock change: re-derive the divisor if the core clock
+ * moved, so the line keeps its baud rate
+ */
+void uart_clock_changed()
+{
+    if (!uart_clock)
+        return; // uart_init() has not run yet
+
+    unsigned int clock = uart_core_clock();
+    if (clock == uart_clock)
+        return;
+
+    uart_flush();
+    uart_clock = clock;
+    uart_program_divisor();
+}
 
 /**
  * Set baud rate and characteristics (115200 8N1) and map to GPIO
@@ -14,10 +101,11 @@ void uart_init()
     AUX_MU_MCR = 0;    // clear RTS (request to send)
     AUX_MU_IER = 0;    // disable interrupts
     AUX_MU_IIR = 0xc6; // enable and clear FIFOs
-    AUX_MU_BAUD = 270; // configure 115200 baud rate [system_clk_freq/(baud_rate*8) - 1]
+    uart_clock = uart_core_clock();
+    uart_program_divisor(); // configure the baud rate from the real core clock
 
     /* Note: refer to page 11 of ARM Peripherals guide for baudrate configuration
-    (system_clk_freq is 250MHz by default) */
+    (system_clk_freq is 250MHz by default, read it from the firmware instead) */
 
     /* map UART1 to GPIO pins 14 and 15 */
     r = GPFSEL1;
@@ -52,9 +140,9 @@ void uart_init()
 }
 
 /**
- * Send a character
+ * Transmit a character and pass it on to the framebuffer console
  */
-void uart_sendc(char c)
+static void uart_tx(char c)
 {
     // wait until transmitter is empty
     do
@@ -64,6 +152,16 @@ void uart_sendc(char c)
 
     // write the character to the buffer
     AUX_MU_IO = c;
+    console_putc(c);
+}
+
+/**
+ * Send a character
+ */
+void uart_sendc(char c)
+{
+    uart_tx(c);
+    console_flush();
 }
 
 /**
@@ -95,9 +193,10 @@ void uart_puts(char *s)
     {
         // convert newline to carriage return + newline
         if (*s == '\n')
-            uart_sendc('\r');
-        uart_sendc(*s++);
+            uart_tx('\r');
+        uart_tx(*s++);
     }
+    console_flush(); // the console draws the string in one go
 }
 void uart_hex_byte(unsigned char byte)
 {
@@ -144,6 +243,14 @@ void uart_dec(int num)
     uart_puts(str);
 }
 
+/**
+ * Non-zero if a received character is waiting
+ */
+int uart_has_data()
+{
+    return AUX_MU_LSR & 0x01;
+}
+
 char uart_get_char()
 {
     char c;
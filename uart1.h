@@ -14,8 +14,14 @@
 #define AUX_MU_STAT     (* (volatile unsigned int*)(MMIO_BASE+0x00215064))
 #define AUX_MU_BAUD     (* (volatile unsigned int*)(MMIO_BASE+0x00215068))
 
+#define UART_DEFAULT_BAUD 115200
+
 /* Function prototypes */
 void uart_init();
+int uart_baud_supported(unsigned int baud);
+unsigned int uart_set_baud(unsigned int baud);
+unsigned int uart_get_baud();
+void uart_clock_changed();
 void uart_sendc(char c);
 char uart_getc();
 void uart_puts(char *s);
@@ -23,3 +29,4 @@ void uart_hex_byte(unsigned char byte);
 void uart_hex(unsigned int d);
 void uart_dec(int num);
 char uart_get_char();
+int uart_has_data();